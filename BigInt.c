@@ -1,5 +1,10 @@
 
+#define _POSIX_C_SOURCE 200809L
 #include "BigInt.h"
+#include "stats.h"
+#include "tune.h"
+#include "bi_ntt.h"
+#include "pool.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -7,28 +12,32 @@
 #include <ctype.h>
 
                                                    
-static BigInt *bi_shift_left_bits(const BigInt *n, size_t k);
 static void    bi_sub_inplace    (BigInt *acc, const BigInt *b);
+static bool    bi_reduce_lazy    (BigInt **x, const BigInt *mod);
+static bool    bi_mulmod_inplace (BigInt **x, const BigInt *y, const BigInt *mod);
 
 // memory helpers
 BigInt *bi_new(size_t len)
 {
-    BigInt *n = malloc(sizeof *n);
-    if (!n) return NULL; // Check malloc success
+    BigInt *n = bi_mem_alloc(sizeof *n);
+    if (!n) return NULL; // Check allocation success
     n->len   = (len ? len : 1);
-    n->limbs = calloc(n->len, sizeof(uint32_t));
-    if (!n->limbs) { // Check calloc success
-        free(n);
+    n->limbs = bi_mem_alloc(n->len * sizeof(uint32_t));
+    if (!n->limbs) { // Check allocation success
+        bi_mem_free(n);
         return NULL;
     }
+    memset(n->limbs, 0, n->len * sizeof(uint32_t));
+    stats_add(ST_ALLOCS, 1);
+    stats_add(ST_ALLOC_BYTES, sizeof *n + n->len * sizeof(uint32_t));
     return n;
 }
 
 void bi_free(BigInt *n)
 {
     if (!n) return;
-    free(n->limbs);
-    free(n);
+    bi_mem_free(n->limbs);
+    bi_mem_free(n);
 }
 
 
@@ -132,7 +141,7 @@ void bi_add(const BigInt *a, const BigInt *b, BigInt **res)
          // Ensure we don't write past allocated space in r
          if (i >= r->len) {
              size_t new_len = r->len + 1;
-             uint32_t *new_limbs = realloc(r->limbs, new_len * sizeof(uint32_t));
+             uint32_t *new_limbs = bi_mem_realloc(r->limbs, new_len * sizeof(uint32_t));
              if (!new_limbs) {
                  fprintf(stderr, "Error: Reallocation failed in bi_add.\n");
                  bi_free(r);
@@ -140,6 +149,8 @@ void bi_add(const BigInt *a, const BigInt *b, BigInt **res)
                  return;
              }
              r->limbs = new_limbs;
+             stats_add(ST_ALLOCS, 1);
+             stats_add(ST_ALLOC_BYTES, sizeof(uint32_t));
              r->limbs[r->len] = 0; // Initialize new limb
              r->len = new_len;
          }
@@ -203,197 +214,170 @@ void bi_sub(const BigInt *a, const BigInt *b, BigInt **res)
 
 
 
-void bi_mul(const BigInt *a, const BigInt *b, BigInt **res)
+// Tuning table, see tune.h.
+BiTuning bi_tuning = {
+    BI_KARATSUBA_THRESHOLD, BI_MODEXP_WINDOW_ABOVE, BI_BZ_THRESHOLD, BI_NEWTON_THRESHOLD,
+    BI_NTT_THRESHOLD, BI_PAR_MUL_THRESHOLD
+};
+
+// r[0..n) += a[0..an) with an <= n; returns the carry out of r[n-1].
+static uint32_t limbs_add_to(uint32_t *r, size_t n, const uint32_t *a, size_t an)
 {
-    // Result can have up to a->len + b->len limbs
-    size_t res_len = a->len + b->len;
-    BigInt *r = bi_new(res_len);
-    if (!r) { *res = NULL; return; } 
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < an; ++i) {
+        uint64_t sum = (uint64_t)r[i] + a[i] + carry;
+        r[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+    for (; carry && i < n; ++i) {
+        uint64_t sum = (uint64_t)r[i] + carry;
+        r[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+    return (uint32_t)carry;
+}
+
+// r[0..n) -= a[0..an) with an <= n; the result must not go negative.
+static void limbs_sub_from(uint32_t *r, size_t n, const uint32_t *a, size_t an)
+{
+    uint32_t borrow = 0;
+    size_t i = 0;
+    for (; i < an; ++i) {
+        uint64_t diff = (uint64_t)r[i] - a[i] - borrow;
+        r[i] = (uint32_t)diff;
+        borrow = (uint32_t)(diff >> 63);   // wrapped below zero
+    }
+    for (; borrow && i < n; ++i) {
+        borrow = (r[i] == 0);
+        r[i]--;
+    }
+    assert(borrow == 0 && "Borrow out of limbs_sub_from");
+}
 
-    for (size_t i = 0; i < a->len; ++i) {
+// Schoolbook product; r[0..an+bn) must be zero on entry.
+static void mul_school(uint32_t *r, const uint32_t *a, size_t an, const uint32_t *b, size_t bn)
+{
+    stats_add(ST_MULADD, (uint64_t)an * bn);
+    for (size_t i = 0; i < an; ++i) {
         uint64_t carry = 0;
         // Don't compute if a limb is zero
-        if (a->limbs[i] == 0) continue;
+        if (a[i] == 0) continue;
 
-        for (size_t j = 0; j < b->len; ++j) {
+        for (size_t j = 0; j < bn; ++j) {
             // Product of two limbs + existing value in result + carry from previous step
-            uint64_t prod = (uint64_t)a->limbs[i] * b->limbs[j]
-                           + r->limbs[i+j] + carry;
-
-            r->limbs[i+j] = (uint32_t)prod; // Lower 32 bits
-            carry = prod >> 32;          // Upper 32 bits (carry)
-        }
-        // Add final carry to the next limb position
-        // This position might already have a value from the outer loop's previous iteration
-        if (carry > 0) {
-            // Propagate carry if necessary 
-            size_t k = i + b->len;
-            while (k < r->len && carry > 0) {
-                 uint64_t sum = (uint64_t)r->limbs[k] + carry;
-                 r->limbs[k] = (uint32_t)sum;
-                 carry = sum >> 32;
-                 k++;
-            }
-            // Assert if carry still exists beyond allocated length
-            assert(carry == 0 && "Carry propagation exceeded allocated length in bi_mul");
+            uint64_t prod = (uint64_t)a[i] * b[j] + r[i+j] + carry;
+            r[i+j] = (uint32_t)prod; // Lower 32 bits
+            carry = prod >> 32;      // Upper 32 bits (carry)
         }
+        // Rows above i have not reached this limb yet, so it is still zero
+        r[i + bn] = (uint32_t)carry;
     }
-    bi_trim(r); 
-    *res = r;   
 }
 
+static bool mul_limbs(uint32_t *r, const uint32_t *a, size_t an, const uint32_t *b, size_t bn);
 
+typedef struct {
+    uint32_t       *r[3];
+    const uint32_t *a[3], *b[3];
+    size_t          n[3];
+    bool            ok[3];
+} KaraTask;
 
-// Calculates q = floor(a / m), r = a mod m                         
-void bi_divmod(const BigInt *a, const BigInt *m, BigInt **q_res, BigInt **r_res)
+static void kara_part(void *ctx, size_t i)
 {
-    // Initialize quotient and remainder
-    BigInt *q = bi_from_u64(0);
-    BigInt *r = bi_copy(a);
-    BigInt *zero = bi_from_u64(0);
-    BigInt *one = bi_from_u64(1); // Needed for divisor check
-    BigInt *d = NULL;             // Intermediate divisor m << shift
-    BigInt *q_term = NULL;        // Intermediate quotient term 2^shift
-    BigInt *shifted_q_term = NULL;// Intermediate quotient term 2^shift (after shifting)
-    BigInt *new_q = NULL;         // Intermediate quotient sum q + q_term
-
-
-    // Handle edge cases and allocation failures
-    if (!q || !r || !zero || !one) {
-        fprintf(stderr, "Error: Allocation failed in bi_divmod setup.\n");
-        goto divmod_error_cleanup;
-    }
-    // Modulus (divisor m) must be > 0
-    if (bi_cmp(m, zero) <= 0) {
-        fprintf(stderr, "Error: Divisor must be > 0 in bi_divmod.\n");
-        goto divmod_error_cleanup;
-    }
-
-    // If a < m, then q=0, r=a
-    if (bi_cmp(a, m) < 0) {
-        // q is already 0 from bi_from_u64
-        if (q_res) *q_res = q; else bi_free(q); q = NULL; 
-        if (r_res) *r_res = r; else bi_free(r); r = NULL; 
-        bi_free(zero); bi_free(one);
-        return;
-    }
-
-    // Main division loop 
-    while (bi_cmp(r, m) >= 0) {
-        size_t r_bits = bi_bitlen(r);
-        size_t m_bits = bi_bitlen(m);
-        if (r_bits < m_bits) break; 
-
-        size_t shift = r_bits - m_bits;
-        d = bi_shift_left_bits(m, shift); // d = m << shift
-        if (!d) goto divmod_error_cleanup;
-
-        if (bi_cmp(r, d) < 0) {
-            bi_free(d); d = NULL;
-            if (shift == 0) {
-                fprintf(stderr, "Internal error in bi_divmod shift calculation (shift=0).\n");
-                goto divmod_error_cleanup; 
-            }
-            shift--;
-            d = bi_shift_left_bits(m, shift);
-            if (!d) goto divmod_error_cleanup;
-        }
+    KaraTask *k = ctx;
+    k->ok[i] = mul_limbs(k->r[i], k->a[i], k->n[i], k->b[i], k->n[i]);
+}
 
-        // Subtract d from remainder r
-        assert(bi_cmp(r, d) >= 0 && "Remainder should be >= adjusted divisor in bi_divmod");
-        bi_sub_inplace(r, d);
-        bi_free(d); d = NULL;
-
-        // Add 2^shift to the quotient q
-        q_term = bi_from_u64(1);
-        if (!q_term) goto divmod_error_cleanup;
-        if (shift > 0) {
-            shifted_q_term = bi_shift_left_bits(q_term, shift);
-             if (!shifted_q_term) goto divmod_error_cleanup;
-            bi_free(q_term); q_term = NULL;
-            q_term = shifted_q_term; shifted_q_term = NULL; 
-        }
-        // q = q + q_term
-        new_q = NULL;
-        bi_add(q, q_term, &new_q);
-        if (!new_q) goto divmod_error_cleanup;
-        bi_free(q); bi_free(q_term); q_term = NULL;
-        q = new_q; new_q = NULL; 
+// Karatsuba for two n-limb operands: with a = a1*B^h + a0 and likewise b,
+// a*b = z2*B^2h + (z1 - z2 - z0)*B^h + z0 where z1 = (a0+a1)(b0+b1),
+// three half-size products instead of four. r[0..2n) must be zero.
+static bool mul_karatsuba(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n)
+{
+    size_t h = n / 2, m = n - h;       // low halves have h limbs, high halves m
+    uint32_t *t = bi_mem_alloc((4 * m + 4) * sizeof *t);
+    if (!t) return false;
+    memset(t, 0, (4 * m + 4) * sizeof *t);
+    uint32_t *sa = t, *sb = t + m + 1, *z1 = t + 2 * m + 2;
+
+    memcpy(sa, a + h, m * sizeof *t);
+    sa[m] = limbs_add_to(sa, m, a, h);
+    memcpy(sb, b + h, m * sizeof *t);
+    sb[m] = limbs_add_to(sb, m, b, h);
+    bool ok;
+    if (n >= bi_tuning.par_mul_limbs && pool_shared_threads() > 1) {
+        // The three products write disjoint limbs, so they can run side by side
+        KaraTask k = { { r, r + 2 * h, z1 }, { a, a + h, sa }, { b, b + h, sb },
+                       { h, m, m + 1 }, { false, false, false } };
+        pool_fork_join(3, kara_part, &k);
+        ok = k.ok[0] && k.ok[1] && k.ok[2];
+    } else {
+        ok = mul_limbs(r, a, h, b, h)                          // z0
+          && mul_limbs(r + 2 * h, a + h, m, b + h, m)          // z2
+          && mul_limbs(z1, sa, m + 1, sb, m + 1);
     }
-
-    
-    bi_free(zero); bi_free(one);
-    if (q_res) *q_res = q; else bi_free(q); 
-    if (r_res) *r_res = r; else bi_free(r); 
-    return;
-
-divmod_error_cleanup:
-    
-    fprintf(stderr, "Error during bi_divmod calculation.\n");
-    bi_free(q); bi_free(r); bi_free(zero); bi_free(one);
-    bi_free(d); bi_free(q_term); bi_free(shifted_q_term); bi_free(new_q);
-    if (q_res) *q_res = NULL; 
-    if (r_res) *r_res = NULL;
+    if (ok) {
+        limbs_sub_from(z1, 2 * m + 2, r, 2 * h);
+        limbs_sub_from(z1, 2 * m + 2, r + 2 * h, 2 * m);
+        // The middle term is below 2*B^n, so it fits the n + m limbs above h
+        size_t zn = 2 * m + 2;
+        while (zn > 0 && z1[zn - 1] == 0) zn--;
+        uint32_t carry = limbs_add_to(r + h, 2 * n - h, z1, zn);
+        assert(carry == 0 && "Carry out of Karatsuba product");
+        (void)carry;
+    }
+    bi_mem_free(t);
+    return ok;
 }
 
-
-
-static BigInt *bi_shift_left_bits(const BigInt *n, size_t k)
+// r[0..an+bn) = a * b; r must be zero on entry. False on allocation failure.
+static bool mul_limbs(uint32_t *r, const uint32_t *a, size_t an, const uint32_t *b, size_t bn)
 {
-    size_t limb_shift = k / 32; // Number of full limbs to shift
-    size_t bit_shift  = k % 32; // Number of bits to shift within limbs
+    if (an < bn) {
+        const uint32_t *tp = a; a = b; b = tp;
+        size_t tn = an; an = bn; bn = tn;
+    }
+    // Below 4 limbs the Karatsuba halves would not shrink
+    if (bn < bi_tuning.karatsuba_limbs || bn < 4) {
+        mul_school(r, a, an, b, bn);
+        return true;
+    }
+    if (bn >= bi_tuning.ntt_limbs && an + bn <= BI_NTT_MAX_LIMBS)
+        return bi_ntt_mul(r, a, an, b, bn);
+    if (an == bn) return mul_karatsuba(r, a, b, an);
+
+    // Unbalanced: multiply b by each bn-limb slice of a and add in place.
+    uint32_t *t = bi_mem_alloc(2 * bn * sizeof *t);
+    if (!t) return false;
+    for (size_t off = 0; off < an; off += bn) {
+        size_t len = (an - off < bn) ? an - off : bn;
+        memset(t, 0, (bn + len) * sizeof *t);
+        if (!mul_limbs(t, b, bn, a + off, len)) { bi_mem_free(t); return false; }
+        limbs_add_to(r + off, an + bn - off, t, bn + len);
+    }
+    bi_mem_free(t);
+    return true;
+}
 
-    // Calculate required length for result: original + full shifts + 1 for potential carry/partial shift
-    size_t res_len = n->len + limb_shift + (bit_shift > 0 ? 1 : 0);
-    if (res_len == 0) res_len = 1; 
+void bi_mul(const BigInt *a, const BigInt *b, BigInt **res)
+{
+    // Result can have up to a->len + b->len limbs
+    size_t res_len = a->len + b->len;
     BigInt *r = bi_new(res_len);
-     if (!r) return NULL;
-
-    if (bit_shift == 0) {
-        for (size_t i = 0; i < n->len; ++i) {
-             if (i + limb_shift < r->len) {
-                r->limbs[i + limb_shift] = n->limbs[i];
-             } else {
-                 fprintf(stderr, "Error: Overflow in bi_shift_left_bits (limb shift).\n");
-                 bi_free(r); return NULL;
-             }
-        }
-    } else {
-        //shift bits across limb boundaries
-        uint32_t carry = 0;
-        size_t i_res = limb_shift; 
-
-        for (size_t i = 0; i < n->len; ++i, ++i_res) {
-            uint64_t current_val = n->limbs[i];
-            // Calculate shifted value and new carry
-            uint64_t shifted_val = (current_val << bit_shift) | carry;
-
-           
-             if (i_res < r->len) {
-                r->limbs[i_res] = (uint32_t)shifted_val;
-             } else {
-                 fprintf(stderr, "Error: Overflow in bi_shift_left_bits (bit shift loop).\n");
-                 bi_free(r); return NULL;
-             }
-            
-            carry = (uint32_t)(current_val >> (32 - bit_shift));
-        }
-        
-        if (carry > 0) {
-             if (i_res < r->len) {
-                r->limbs[i_res] = carry;
-             } else {
-                  fprintf(stderr, "Error: Overflow in bi_shift_left_bits (final carry).\n");
-                  bi_free(r); return NULL;
-             }
-        }
-    }
+    if (!r) { *res = NULL; return; } 
+    stats_add(ST_MUL_CALLS, 1);
 
-    bi_trim(r);
-    return r;
+    if (!mul_limbs(r->limbs, a->limbs, a->len, b->limbs, b->len)) {
+        fprintf(stderr, "Error: Allocation failed in bi_mul.\n");
+        bi_free(r);
+        *res = NULL;
+        return;
+    }
+    bi_trim(r); 
+    *res = r;   
 }
 
-
 void bi_mod(const BigInt *a, const BigInt *m, BigInt **res)
 {
     BigInt *q_discard = NULL;
@@ -402,84 +386,233 @@ void bi_mod(const BigInt *a, const BigInt *m, BigInt **res)
     
 }
 
-void bi_modexp(const BigInt *base, const BigInt *exp, const BigInt *mod,  BigInt **res)
+// Sliding-window width for an exponent of `bits` bits.
+static unsigned modexp_window(size_t bits)
 {
-    BigInt *x = bi_copy(base);               
-    BigInt *y = bi_from_u64(1);              
-    BigInt *tmp_mul = NULL;                 
-    BigInt *tmp_mod = NULL;                  
-    BigInt *one = NULL;                      
+    unsigned w = 1;
+    while (w < BI_MODEXP_MAX_WINDOW && bits > bi_tuning.window_above[w - 1]) w++;
+    return w;
+}
+
+#define EXP_BIT(e, i) (((e)->limbs[(i) / 32] >> ((i) % 32)) & 1)
 
-    if (!x || !y) {
-        fprintf(stderr, "Error: Allocation failed at start of bi_modexp.\n");
-        bi_free(x); bi_free(y); *res = NULL; return;
+#if (1u << (BI_MODEXP_MAX_WINDOW - 1)) > 32
+#error "BiModexpCtx.odd in BigInt.h is too small for BI_MODEXP_MAX_WINDOW"
+#endif
+
+enum { MX_TABLE, MX_BITS, MX_SQUARE, MX_DONE, MX_FAILED };
+
+// Left-to-right sliding window: precompute base^1, base^3, ..., base^(2^w - 1),
+// then every run of up to w exponent bits that ends in a 1 costs one multiply.
+// The loop is a small state machine so that it can stop after any mulmod.
+bool bi_modexp_start(BiModexpCtx *ctx, const BigInt *base, const BigInt *exp, const BigInt *mod)
+{
+    memset(ctx, 0, sizeof *ctx);
+    ctx->state = MX_FAILED;
+    // Modulus must be >= 2
+    if (bi_bitlen(mod) < 2) {
+        fprintf(stderr, "Error: Modulus must be >= 2 for bi_modexp.\n");
+        return false;
     }
-    // Modulus must be >= 2 
-    one = bi_from_u64(1);
-    if (!one) { goto modexp_error;} 
-    if (bi_cmp(mod, one) <= 0) {
-         fprintf(stderr, "Error: Modulus must be >= 2 for bi_modexp.\n");
-         bi_free(one); one = NULL; goto modexp_error;
+    ctx->bits = bi_bitlen(exp);
+    // exp = 0: y stays NULL, which stands for 1
+    if (ctx->bits == 0 || (ctx->bits == 1 && exp->limbs[0] == 0)) {
+        ctx->state = MX_DONE;
+        return true;
     }
-    bi_free(one); one = NULL;
 
-    
-    bi_mod(x, mod, &tmp_mod);
-    if (!tmp_mod) { goto modexp_error; } 
-    bi_free(x); x = tmp_mod; tmp_mod = NULL;
+    ctx->exp    = bi_copy(exp);
+    ctx->mod    = bi_copy(mod);
+    ctx->odd[0] = bi_copy(base);
+    ctx->nodd   = 1;
+    if (!ctx->exp || !ctx->mod || !ctx->odd[0]) goto start_error;
+    bi_trim(ctx->mod);
+    bi_trim(ctx->odd[0]);
+    if (!bi_reduce_lazy(&ctx->odd[0], ctx->mod)) goto start_error;
+
+    unsigned w = modexp_window(ctx->bits);
+    ctx->w     = w;
+    ctx->i     = ctx->bits;              // bits [0, i) are still to be consumed
+    ctx->state = (w > 1) ? MX_TABLE : MX_BITS;
+    return true;
+
+start_error:
+    fprintf(stderr, "Error during bi_modexp calculation.\n");
+    return false;
+}
 
-    size_t bits = bi_bitlen(exp);
-    // Handle exp = 0 case 
-    if (bits == 1 && exp->limbs[0] == 0) {
-        bi_free(x); 
-        bi_free(y); 
-        *res = bi_from_u64(1); 
-        return;
+int bi_modexp_step(BiModexpCtx *ctx, size_t budget)
+{
+    const BigInt *exp = ctx->exp, *mod = ctx->mod;
+
+    for (size_t done = 0; done < budget;) {
+        switch (ctx->state) {
+        case MX_TABLE:
+            if (!ctx->sq) {
+                ctx->sq = bi_copy(ctx->odd[0]);
+                if (!ctx->sq || !bi_mulmod_inplace(&ctx->sq, ctx->odd[0], mod)) goto step_error;
+            } else {
+                size_t k = ctx->nodd;
+                ctx->odd[k] = bi_copy(ctx->odd[k - 1]);
+                ctx->nodd++;
+                if (!ctx->odd[k] || !bi_mulmod_inplace(&ctx->odd[k], ctx->sq, mod)) goto step_error;
+                if (ctx->nodd == (1u << (ctx->w - 1))) {
+                    bi_free(ctx->sq); ctx->sq = NULL;
+                    ctx->state = MX_BITS;
+                }
+            }
+            done++;
+            break;
+
+        case MX_BITS:
+            if (ctx->i == 0) {
+                ctx->state = MX_DONE;
+                break;
+            }
+            if (!EXP_BIT(exp, ctx->i - 1)) {
+                if (ctx->y && !bi_mulmod_inplace(&ctx->y, ctx->y, mod)) goto step_error;
+                ctx->i--;
+                done++;
+                break;
+            }
+            // Window [lo, i): at most w bits, lowest bit set so the value is odd
+            ctx->lo = (ctx->i > ctx->w) ? ctx->i - ctx->w : 0;
+            while (!EXP_BIT(exp, ctx->lo)) ctx->lo++;
+            ctx->val = 0;
+            for (size_t k = ctx->i; k > ctx->lo; --k) ctx->val = (ctx->val << 1) | EXP_BIT(exp, k - 1);
+            ctx->state = MX_SQUARE;
+            break;
+
+        case MX_SQUARE:
+            // One squaring per window bit, then the multiply by the table entry
+            if (ctx->i > ctx->lo) {
+                if (ctx->y && !bi_mulmod_inplace(&ctx->y, ctx->y, mod)) goto step_error;
+                ctx->i--;
+            } else {
+                if (ctx->y) {
+                    if (!bi_mulmod_inplace(&ctx->y, ctx->odd[ctx->val >> 1], mod)) goto step_error;
+                } else if (!(ctx->y = bi_copy(ctx->odd[ctx->val >> 1]))) {
+                    goto step_error;
+                }
+                ctx->state = MX_BITS;
+            }
+            done++;
+            break;
+
+        case MX_DONE:
+            return 0;
+        default:
+            return -1;
+        }
     }
+    return ctx->state == MX_DONE ? 0 : 1;
 
+step_error:
+    fprintf(stderr, "Error during bi_modexp calculation.\n");
+    ctx->state = MX_FAILED;
+    return -1;
+}
 
-    for (size_t i = 0; i < bits; ++i) {
-        // If i-th bit of exp is 1, y = (y * x) mod mod
-        if ((exp->limbs[i/32] >> (i%32)) & 1) {
-            bi_mul(y, x, &tmp_mul);    
-            if (!tmp_mul) {goto modexp_error; }
+void bi_modexp_finish(BiModexpCtx *ctx, BigInt **res)
+{
+    BigInt *y = NULL;
+    if (ctx->state == MX_DONE) {
+        y = ctx->y ? ctx->y : bi_from_u64(1);
+        ctx->y = NULL;
+    }
+    for (size_t k = 0; k < ctx->nodd; ++k) bi_free(ctx->odd[k]);
+    bi_free(ctx->sq);
+    bi_free(ctx->y);
+    bi_free(ctx->exp);
+    bi_free(ctx->mod);
+    memset(ctx, 0, sizeof *ctx);
+    ctx->state = MX_FAILED;
+    if (res) *res = y;
+    else     bi_free(y);
+}
 
-            bi_mod(tmp_mul, mod, &tmp_mod); 
-            if (!tmp_mod) {goto modexp_error; }
+void bi_modexp(const BigInt *base, const BigInt *exp, const BigInt *mod,  BigInt **res)
+{
+    BiModexpCtx ctx;
+    if (bi_modexp_start(&ctx, base, exp, mod)) bi_modexp_step(&ctx, SIZE_MAX);
+    bi_modexp_finish(&ctx, res);
+}
 
-            bi_free(tmp_mul); tmp_mul = NULL;
-            bi_free(y);                      
-            y = tmp_mod; tmp_mod = NULL;     
-        }
 
-        // Square step: x = (x * x) mod mod
+// Reduce *x modulo mod in place, but only when it is not already reduced.
+// Small-exponent chains square values that are often still below mod
+// (short messages), so the divmod is skipped whenever the limb count
+// already proves x < mod.
+static bool bi_reduce_lazy(BigInt **x, const BigInt *mod)
+{
+    if ((*x)->len < mod->len) return true;
+    if ((*x)->len == mod->len && bi_cmp(*x, mod) < 0) return true;
+
+    BigInt *r = NULL;
+    bi_mod(*x, mod, &r);
+    if (!r) return false;
+    bi_free(*x);
+    *x = r;
+    return true;
+}
 
-        if (i < bits - 1) {
-            bi_mul(x, x, &tmp_mul);       
-            if (!tmp_mul) {goto modexp_error; }
+// x = x * y mod mod (y may alias x for a squaring)
+static bool bi_mulmod_inplace(BigInt **x, const BigInt *y, const BigInt *mod)
+{
+    BigInt *t = NULL;
+    bi_mul(*x, y, &t);
+    if (!t) return false;
+    bi_free(*x);
+    *x = t;
+    return bi_reduce_lazy(x, mod);
+}
 
-            bi_mod(tmp_mul, mod, &tmp_mod); 
-            if (!tmp_mod) {goto modexp_error; }
+void bi_modexp_small(const BigInt *base, uint32_t e, const BigInt *mod, BigInt **res)
+{
+    BigInt *x = NULL;      // base reduced mod mod
+    BigInt *y = NULL;      // accumulator
 
-            bi_free(tmp_mul); tmp_mul = NULL;
-            bi_free(x);                      
-            x = tmp_mod; tmp_mod = NULL;     
+    if (mod->len == 1 && mod->limbs[0] <= 1) {
+        fprintf(stderr, "Error: Modulus must be >= 2 for bi_modexp_small.\n");
+        *res = NULL; return;
+    }
+    if (e == 0) { *res = bi_from_u64(1); return; }
+
+    x = bi_copy(base);
+    if (!x || !bi_reduce_lazy(&x, mod)) goto small_error;
+    y = bi_copy(x);
+    if (!y) goto small_error;
+
+    if (e >= 3 && ((e - 1) & (e - 2)) == 0) {
+        // Fermat-style exponents 2^k + 1 (3, 5, 17, 257, 65537):
+        // k squarings followed by a single multiply by the base.
+        uint32_t k = 0;
+        while ((1u << k) != e - 1) k++;
+        for (uint32_t i = 0; i < k; ++i) {
+            if (!bi_mulmod_inplace(&y, y, mod)) goto small_error;
+        }
+        if (!bi_mulmod_inplace(&y, x, mod)) goto small_error;
+    } else {
+        // Generic left-to-right square-and-multiply over one 32-bit word.
+        int top = 31;
+        while (!((e >> top) & 1)) top--;
+        for (int i = top - 1; i >= 0; --i) {
+            if (!bi_mulmod_inplace(&y, y, mod)) goto small_error;
+            if ((e >> i) & 1) {
+                if (!bi_mulmod_inplace(&y, x, mod)) goto small_error;
+            }
         }
     }
 
-    bi_free(x); 
-    *res = y;   
+    bi_free(x);
+    *res = y;
     return;
 
-modexp_error:
-    
-    fprintf(stderr, "Error during bi_modexp calculation.\n");
+small_error:
+    fprintf(stderr, "Error during bi_modexp_small calculation.\n");
     bi_free(x);
     bi_free(y);
-    bi_free(tmp_mul);
-    bi_free(tmp_mod);
-    bi_free(one); 
-    *res = NULL; 
+    *res = NULL;
 }
 
 
@@ -487,18 +620,17 @@ void bi_gcd(const BigInt *a, const BigInt *b, BigInt **res)
 {
     BigInt *x = bi_copy(a);
     BigInt *y = bi_copy(b);
-    BigInt *zero = bi_from_u64(0);
     BigInt *tmp;
 
-    if (!x || !y || !zero) { 
-        bi_free(x); bi_free(y); bi_free(zero);
+    if (!x || !y) { 
+        bi_free(x); bi_free(y);
         *res = NULL; return;
     }
 
-    while (bi_cmp(y, zero) != 0) { // while y != 0
+    while (bi_cmp_u64(y, 0) != 0) { // while y != 0
         bi_mod(x, y, &tmp); // tmp = x mod y
         if (!tmp) { 
-             bi_free(x); bi_free(y); bi_free(zero);
+             bi_free(x); bi_free(y);
              *res = NULL; return;
         }
         bi_free(x); 
@@ -507,116 +639,207 @@ void bi_gcd(const BigInt *a, const BigInt *b, BigInt **res)
     }
 
     bi_free(y); 
-    bi_free(zero);
     *res = x;   
 }
 
 
+/* Extended Euclid for 0 < a < m, without messages: 1 with *inv set,
+ * 0 if gcd(a, m) != 1, -1 on allocation failure.
+ */
+static int modinv_euclid(const BigInt *a, const BigInt *m, BigInt **inv)
+{
+    BigInt *t_prev = bi_copy(m), *t_curr = bi_copy(a);
+    BigInt *s_prev = bi_from_u64(0), *s_curr = bi_from_u64(1);   // coefficients for a
+    BigInt *q = NULL, *tmp_r = NULL, *term = NULL, *tmp_s = NULL, *sub_res = NULL;
+    int rc = -1;
+    *inv = NULL;
+    if (!t_prev || !t_curr || !s_prev || !s_curr) goto cleanup;
+
+    while (bi_cmp_u64(t_curr, 0) != 0) {
+        bi_divmod(t_prev, t_curr, &q, &tmp_r);
+        if (!q || !tmp_r) goto cleanup;
+        bi_free(t_prev);
+        t_prev = t_curr;
+        t_curr = tmp_r; tmp_r = NULL;
+
+        // s_next = s_prev - q * s_curr, kept in [0, m)
+        bi_mul(q, s_curr, &term);
+        if (!term) goto cleanup;
+        bi_mod(term, m, &tmp_s);
+        if (!tmp_s) goto cleanup;
+        bi_free(term); term = tmp_s; tmp_s = NULL;
+
+        if (bi_cmp(s_prev, term) >= 0) {
+            bi_sub(s_prev, term, &sub_res);
+        } else {
+            bi_sub(term, s_prev, &tmp_s);
+            if (!tmp_s) goto cleanup;
+            assert(bi_cmp(m, tmp_s) >= 0 && "m < (term-s_prev) in modinv");
+            bi_sub(m, tmp_s, &sub_res);
+        }
+        if (!sub_res) goto cleanup;
+        bi_free(s_prev);
+        s_prev = s_curr;
+        s_curr = sub_res; sub_res = NULL;
+
+        bi_free(q); q = NULL;
+        bi_free(term); term = NULL;
+        bi_free(tmp_s); tmp_s = NULL;
+    }
+
+    if (bi_cmp_u64(t_prev, 1) != 0) {
+        rc = 0;
+    } else {
+        bi_mod(s_prev, m, inv);
+        rc = *inv ? 1 : -1;
+    }
+
+cleanup:
+    bi_free(t_prev); bi_free(t_curr); bi_free(s_prev); bi_free(s_curr);
+    bi_free(q); bi_free(tmp_r); bi_free(term); bi_free(tmp_s); bi_free(sub_res);
+    return rc;
+}
+
 bool bi_modinv(const BigInt *a, const BigInt *m, BigInt **inv)
 {
+    *inv = NULL;
     // Ensure m > 1
-    BigInt *one_check = bi_from_u64(1);
-    if (!one_check) { *inv = NULL; return false; }
-    if (bi_cmp(m, one_check) <= 0) {
+    if (bi_cmp_u64(m, 1) <= 0) {
         fprintf(stderr, "Error: Modulus must be > 1 for bi_modinv.\n");
-        bi_free(one_check);
-        *inv = NULL; return false;
+        return false;
     }
-    bi_free(one_check); one_check = NULL; 
 
     // Reduce a mod m initially
     BigInt *a_reduced = NULL;
     bi_mod(a, m, &a_reduced);
-    if (!a_reduced) { *inv = NULL; return false; } 
+    if (!a_reduced) return false;
 
     // If a mod m is 0, inverse doesn't exist
-    BigInt *zero_check = bi_from_u64(0);
-    if (!zero_check) { bi_free(a_reduced); *inv = NULL; return false; }
-    if (bi_cmp(a_reduced, zero_check) == 0) {
+    if (bi_cmp_u64(a_reduced, 0) == 0) {
         fprintf(stderr, "Error: Cannot compute inverse of 0 mod m.\n");
-        bi_free(a_reduced); bi_free(zero_check);
-        *inv = NULL; return false;
+        bi_free(a_reduced);
+        return false;
     }
-    bi_free(zero_check); zero_check = NULL; 
-
-
-    // Standard Extended Euclidean Algorithm variables
-    BigInt *t_prev = NULL, *t_curr = NULL; 
-    BigInt *s_prev = NULL, *s_curr = NULL; // Coefficients for 'a'
-    BigInt *q = NULL, *tmp_r = NULL, *term = NULL, *tmp_s = NULL, *sub_res = NULL;
-
-    // Initialize based on standard algorithm for inverse of 'a' mod 'm'
-    t_prev = bi_copy(m);             
-    t_curr = a_reduced;              
-    s_prev = bi_from_u64(0);         
-    s_curr = bi_from_u64(1);         
-    BigInt *zero = bi_from_u64(0);   
-    BigInt *one = bi_from_u64(1);    
 
+    int rc = modinv_euclid(a_reduced, m, inv);
+    bi_free(a_reduced);
+    if (rc == 0) fprintf(stderr, "Error: Inverse does not exist (gcd is not 1).\n");
+    if (rc < 0)  fprintf(stderr, "Error during bi_modinv calculation.\n");
+    return rc == 1;
+}
 
-    if (!t_prev || !t_curr || !s_prev || !s_curr || !zero || !one) goto modinv_error_cleanup_std;
+/* Montgomery's trick: with prefix products c_i = a_0 ... a_i, one inverse
+ * of c_{n-1} unwinds into every a_i^-1 through a_i^-1 = c_{i-1} * c_i^-1 and
+ * c_{i-1}^-1 = a_i * c_i^-1, so n inverses cost one Euclid and 3(n-1)
+ * modular products. A value sharing a factor with m would make the whole
+ * product non-invertible; when that happens the culprits are found with a
+ * gcd each and the trick is rerun on the rest.
+ */
+bool bi_modinv_batch(const BigInt *const *values, size_t count, const BigInt *m, BigInt **out)
+{
+    for (size_t i = 0; i < count; ++i) out[i] = NULL;
+    if (count == 0) return true;
+    if (bi_cmp_u64(m, 1) <= 0) {
+        fprintf(stderr, "Error: Modulus must be > 1 for bi_modinv_batch.\n");
+        return false;
+    }
 
-     while (bi_cmp(t_curr, zero) != 0) { 
-        // Calculate quotient q and remainder r (new t_curr)
-        bi_divmod(t_prev, t_curr, &q, &tmp_r); 
-        if (!q || !tmp_r) goto modinv_error_cleanup_std;
+    // a[i] = values[i] mod m, NULL for values already known to have no inverse
+    BigInt **a = bi_mem_alloc(2 * count * sizeof *a);
+    if (!a) return false;
+    BigInt **c = a + count;
+    size_t *live = bi_mem_alloc(count * sizeof *live);
+    bool ok = live != NULL;
+    for (size_t i = 0; i < 2 * count; ++i) a[i] = NULL;
+    for (size_t i = 0; ok && i < count; ++i) {
+        bi_mod(values[i], m, &a[i]);
+        if (!a[i]) ok = false;
+        else if (bi_cmp_u64(a[i], 0) == 0) { bi_free(a[i]); a[i] = NULL; }
+    }
 
-        
-        bi_free(t_prev);
-        t_prev = t_curr;
-        t_curr = tmp_r; tmp_r = NULL;
+    while (ok) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; ++i) if (a[i]) live[n++] = i;
+        if (n == 0) break;
+
+        // Prefix products
+        c[0] = bi_copy(a[live[0]]);
+        ok = c[0] != NULL;
+        for (size_t k = 1; ok && k < n; ++k) {
+            BigInt *t = NULL;
+            bi_mul(c[k - 1], a[live[k]], &t);
+            if (t) bi_mod(t, m, &c[k]);
+            bi_free(t);
+            ok = c[k] != NULL;
+        }
+        if (!ok) break;
+
+        BigInt *inv = NULL;
+        int rc = modinv_euclid(c[n - 1], m, &inv);
+        if (rc < 0) { ok = false; break; }
+        if (rc == 0) {
+            // Drop the values that share a factor with m and go again
+            for (size_t k = 0; ok && k < n; ++k) {
+                BigInt *g = NULL;
+                bi_gcd(a[live[k]], m, &g);
+                if (!g) { ok = false; break; }
+                if (bi_cmp_u64(g, 1) != 0) { bi_free(a[live[k]]); a[live[k]] = NULL; }
+                bi_free(g);
+            }
+            for (size_t k = 0; k < n; ++k) { bi_free(c[k]); c[k] = NULL; }
+            continue;
+        }
 
-        
-        bi_mul(q, s_curr, &term);
-        if (!term) goto modinv_error_cleanup_std;
-        bi_mod(term, m, &tmp_s);  
-        if (!tmp_s) goto modinv_error_cleanup_std;
-        bi_free(term); term = tmp_s; tmp_s = NULL; 
-        
-        if (bi_cmp(s_prev, term) >= 0) {
-            bi_sub(s_prev, term, &sub_res); 
-            if (!sub_res) goto modinv_error_cleanup_std;
-        } else {
-            
-            bi_sub(term, s_prev, &tmp_s); 
-            if (!tmp_s) goto modinv_error_cleanup_std;
-             assert(bi_cmp(m, tmp_s) >= 0 && "m < (term-s_prev) in modinv");
-             bi_sub(m, tmp_s, &sub_res); 
-             if (!sub_res) {bi_free(tmp_s); goto modinv_error_cleanup_std;}
-             bi_free(tmp_s); tmp_s = NULL;
+        // Unwind: inv = c_k^-1 on entry to each step
+        for (size_t k = n - 1; ok && k > 0; --k) {
+            BigInt *t = NULL, *next = NULL;
+            bi_mul(c[k - 1], inv, &t);
+            if (t) bi_mod(t, m, &out[live[k]]);
+            bi_free(t); t = NULL;
+            bi_mul(a[live[k]], inv, &t);
+            if (t) bi_mod(t, m, &next);
+            bi_free(t);
+            bi_free(inv);
+            inv = next;
+            ok = out[live[k]] && inv;
         }
-        
-        bi_free(s_prev);
-        s_prev = s_curr;
-        s_curr = sub_res; sub_res = NULL; 
+        if (ok) { out[live[0]] = inv; inv = NULL; }
+        bi_free(inv);
+        break;
+    }
 
-        bi_free(q); q = NULL;
-        bi_free(term); term = NULL;
-     } 
-
-     
-     if (bi_cmp(t_prev, one) != 0) {
-        fprintf(stderr, "Error: Inverse does not exist (gcd is not 1).\n");
-        bi_free(t_prev); 
-        t_prev = NULL;
-        *inv = NULL;
-     } else {
-        bi_mod(s_prev, m, inv);
-        if (!*inv) goto modinv_error_cleanup_std; 
-     }
+    for (size_t i = 0; i < 2 * count; ++i) bi_free(a[i]);
+    bi_mem_free(a);
+    bi_mem_free(live);
+    if (!ok) {
+        fprintf(stderr, "Error during bi_modinv_batch calculation.\n");
+        for (size_t i = 0; i < count; ++i) { bi_free(out[i]); out[i] = NULL; }
+    }
+    return ok;
+}
 
 
-    return (*inv != NULL);
+BigInt *bi_from_bytes_be(const unsigned char *buf, size_t len)
+{
+    BigInt *n = bi_new((len + 3) / 4);
+    if (!n) return NULL;
+    for (size_t i = 0; i < len; ++i) {
+        n->limbs[i / 4] |= (uint32_t)buf[len - 1 - i] << ((i % 4) * 8);
+    }
+    bi_trim(n);
+    return n;
+}
 
-modinv_error_cleanup_std: 
-     fprintf(stderr, "Error during bi_modinv calculation.\n");
-    
-    bi_free(t_prev); bi_free(t_curr); bi_free(s_prev); bi_free(s_curr);
-    bi_free(zero); bi_free(one); bi_free(q); bi_free(tmp_r);
-    bi_free(term); bi_free(tmp_s); bi_free(sub_res);
-    bi_free(a_reduced); 
-    *inv = NULL; 
-    return false;
+bool bi_to_bytes_be(const BigInt *n, unsigned char *buf, size_t width)
+{
+    if (!n || !buf) return false;
+    if ((bi_bitlen(n) + 7) / 8 > width && !(n->len == 1 && n->limbs[0] == 0)) return false;
+
+    memset(buf, 0, width);
+    for (size_t i = 0; i < width && i / 4 < n->len; ++i) {
+        buf[width - 1 - i] = (unsigned char)(n->limbs[i / 4] >> ((i % 4) * 8));
+    }
+    return true;
 }
 
 
@@ -758,3 +981,196 @@ BigInt *bi_read_hex(FILE *fp)
     bi_trim(n); 
     return n;
 }
+
+
+/* Decimal conversion.
+ *
+ * Both directions split the number around cached powers P[k] = 10^(9 * 2^k),
+ * so a value of n limbs costs a few multiplications or divisions of each
+ * size instead of n passes over n limbs. Below DEC_LEAF_LIMBS the pieces
+ * are converted directly in base 10^9, one machine word per 9 digits.
+ */
+#define DEC_LEAF_LIMBS  8
+#define DEC_LEAF_WIDTH  81        // enough digits for any DEC_LEAF_LIMBS value
+#define DEC_LEAF_DIGITS 72        // parsed leaves: 10^72 fits DEC_LEAF_LIMBS
+#define DEC_BASE        1000000000u
+
+typedef struct {
+    BigInt *p[40];                // p[k] = 10^(9 * 2^k); 2^40 groups is plenty
+    size_t  n;
+} DecPowers;
+
+static void dec_powers_free(DecPowers *pw)
+{
+    for (size_t k = 0; k < pw->n; ++k) bi_free(pw->p[k]);
+    pw->n = 0;
+}
+
+// Makes sure p[0..k] exist.
+static bool dec_powers_upto(DecPowers *pw, size_t k)
+{
+    if (k >= 40) return false;
+    if (pw->n == 0) {
+        if (!(pw->p[0] = bi_from_u64(DEC_BASE))) return false;
+        pw->n = 1;
+    }
+    while (pw->n <= k) {
+        BigInt *sq = NULL;
+        bi_mul(pw->p[pw->n - 1], pw->p[pw->n - 1], &sq);
+        if (!sq) return false;
+        pw->p[pw->n++] = sq;
+    }
+    return true;
+}
+
+// Writes x as exactly `width` digits, zero-padded on the left.
+static void dec_leaf(const BigInt *x, char *out, size_t width)
+{
+    uint32_t w[DEC_LEAF_LIMBS];
+    BigInt t = { x->len, w };
+    while (t.len > 1 && x->limbs[t.len - 1] == 0) t.len--;
+    memcpy(w, x->limbs, t.len * sizeof *w);
+
+    char *p = out + width;
+    while (p > out) {
+        uint32_t rem = bi_divmod_u32(&t, DEC_BASE);
+        for (int d = 0; d < 9 && p > out; ++d) {
+            *--p = (char)('0' + rem % 10);
+            rem /= 10;
+        }
+    }
+}
+
+// x < 10^width with width = 9 * 2^(k+1); writes exactly width digits.
+static bool dec_split(const BigInt *x, const DecPowers *pw, size_t k, char *out, size_t width)
+{
+    size_t n = x->len;
+    while (n > 1 && x->limbs[n - 1] == 0) n--;
+    if (n <= DEC_LEAF_LIMBS) {
+        size_t lead = (width > DEC_LEAF_WIDTH) ? width - DEC_LEAF_WIDTH : 0;
+        memset(out, '0', lead);
+        dec_leaf(x, out + lead, width - lead);
+        return true;
+    }
+    BigInt *hi = NULL, *lo = NULL;
+    bi_divmod(x, pw->p[k], &hi, &lo);
+    if (!hi || !lo) { bi_free(hi); bi_free(lo); return false; }
+    bool ok = dec_split(hi, pw, k - 1, out, width / 2)
+           && dec_split(lo, pw, k - 1, out + width / 2, width / 2);
+    bi_free(hi);
+    bi_free(lo);
+    return ok;
+}
+
+char *bi_to_dec(const BigInt *n)
+{
+    if (!n) return NULL;
+    size_t len = n->len;
+    while (len > 1 && n->limbs[len - 1] == 0) len--;
+
+    DecPowers pw = { .n = 0 };
+    size_t k = 0, width = DEC_LEAF_WIDTH;
+    if (len > DEC_LEAF_LIMBS) {
+        // The smallest k with n < p[k]^2, which holds once p[k]^2 has more bits
+        size_t bits = bi_bitlen(n);
+        for (;; ++k) {
+            if (!dec_powers_upto(&pw, k)) goto dec_error;
+            if (2 * bi_bitlen(pw.p[k]) - 1 > bits) break;
+        }
+        width = (size_t)18 << k;
+    }
+
+    char *s = malloc(width + 1);
+    if (!s) goto dec_error;
+    if (!dec_split(n, &pw, k, s, width)) { free(s); goto dec_error; }
+    s[width] = '\0';
+
+    size_t z = 0;
+    while (z + 1 < width && s[z] == '0') z++;
+    memmove(s, s + z, width - z + 1);
+    dec_powers_free(&pw);
+    return s;
+
+dec_error:
+    fprintf(stderr, "Error: Allocation failed in bi_to_dec.\n");
+    dec_powers_free(&pw);
+    return NULL;
+}
+
+// digits[0..len) with len <= DEC_LEAF_DIGITS, by Horner's rule in base 10^9.
+static BigInt *dec_parse_leaf(const char *digits, size_t len)
+{
+    BigInt *x = bi_new(DEC_LEAF_LIMBS);
+    if (!x) return NULL;
+    size_t used = 1;
+    size_t first = len % 9 ? len % 9 : 9;
+    for (size_t pos = 0; pos < len;) {
+        size_t take = pos ? 9 : first;
+        uint32_t chunk = 0, scale = 1;
+        for (size_t d = 0; d < take; ++d) {
+            chunk = chunk * 10 + (uint32_t)(digits[pos + d] - '0');
+            scale *= 10;
+        }
+        pos += take;
+        uint64_t carry = chunk;
+        for (size_t i = 0; i < used; ++i) {
+            uint64_t t = (uint64_t)x->limbs[i] * scale + carry;
+            x->limbs[i] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry) x->limbs[used++] = (uint32_t)carry;
+    }
+    bi_trim(x);
+    return x;
+}
+
+static BigInt *dec_join(const char *digits, size_t len, DecPowers *pw)
+{
+    if (len <= DEC_LEAF_DIGITS) return dec_parse_leaf(digits, len);
+
+    // Split off the low 9 * 2^k digits, the largest such block below len
+    size_t k = 0;
+    while (((size_t)18 << k) < len) k++;
+    size_t low = (size_t)9 << k;
+
+    BigInt *hi = dec_join(digits, len - low, pw);
+    BigInt *lo = dec_join(digits + len - low, low, pw);
+    BigInt *t = NULL, *r = NULL;
+    if (hi && lo) bi_mul(hi, pw->p[k], &t);
+    if (t) bi_add(t, lo, &r);
+    bi_free(hi); bi_free(lo); bi_free(t);
+    return r;
+}
+
+BigInt *bi_from_dec(const char *s)
+{
+    if (!s) return NULL;
+    while (isspace((unsigned char)*s)) s++;
+    size_t len = 0;
+    while (isdigit((unsigned char)s[len])) len++;
+    for (size_t i = len; s[i]; ++i) {
+        if (!isspace((unsigned char)s[i])) {
+            fprintf(stderr, "Error: Invalid non-decimal character '%c' in input.\n", s[i]);
+            return NULL;
+        }
+    }
+    if (len == 0) {
+        fprintf(stderr, "Error: Empty decimal input.\n");
+        return NULL;
+    }
+    while (len > 1 && *s == '0') { s++; len--; }
+
+    // dec_join splits at p[k] for the smallest k with 18 * 2^k >= len
+    DecPowers pw = { .n = 0 };
+    size_t k = 0;
+    while (((size_t)18 << k) < len) k++;
+    if (len > DEC_LEAF_DIGITS && !dec_powers_upto(&pw, k)) {
+        fprintf(stderr, "Error: Allocation failed in bi_from_dec.\n");
+        dec_powers_free(&pw);
+        return NULL;
+    }
+    BigInt *x = dec_join(s, len, &pw);
+    if (!x) fprintf(stderr, "Error: Allocation failed in bi_from_dec.\n");
+    dec_powers_free(&pw);
+    return x;
+}
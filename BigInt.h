@@ -27,12 +27,122 @@ void bi_sub(const BigInt *a, const BigInt *b, BigInt **res);      // a must be g
 void bi_mul(const BigInt *a, const BigInt *b, BigInt **res);      
 void bi_mod(const BigInt *a, const BigInt *m, BigInt **res);      
 
+/* One-word operands, in place (bi_word.c). Nothing is allocated except one
+ * extra limb when an add or multiply carries out of the top (false if that
+ * fails). Divisors must be nonzero.
+ */
+bool     bi_add_u32   (BigInt *a, uint32_t v);             // a += v
+void     bi_sub_u32   (BigInt *a, uint32_t v);             // a -= v, a must be >= v
+bool     bi_mul_u32   (BigInt *a, uint32_t v);             // a *= v
+uint32_t bi_divmod_u32(BigInt *a, uint32_t d);             // a /= d, returns the remainder
+uint32_t bi_mod_u32   (const BigInt *a, uint32_t d);
+int      bi_cmp_u64   (const BigInt *a, uint64_t v);       // a need not be trimmed
+
 void bi_divmod(const BigInt *a, const BigInt *m, BigInt **q_res, BigInt **r_res);
 void bi_modexp(const BigInt *base, const BigInt *exp, const BigInt *mod,  BigInt **res);                    
+void bi_modexp_small(const BigInt *base, uint32_t e, const BigInt *mod, BigInt **res); // fixed chains for e < 2^32
+// bi_modexp split over up to `threads` threads of the shared pool (bi_pexp.c):
+// lower latency, more total work. Short exponents run serially.
+void bi_modexp_par(const BigInt *base, const BigInt *exp, const BigInt *mod, size_t threads, BigInt **res);
+
+/* bi_modexp in slices, for event loops that cannot block for a whole
+ * exponentiation. start copies the operands into the caller's context;
+ * each step then does at most `budget` modular multiplications and
+ * returns 1 while there is more to do, 0 when the result is ready and
+ * -1 on error. finish hands over the result (NULL unless a step returned
+ * 0; pass res = NULL to abandon) and must be called once start has run,
+ * whatever it returned. bi_modexp is start, one unbounded step, finish.
+ */
+typedef struct {
+    BigInt  *exp, *mod;
+    BigInt  *odd[32];     // odd[k] = base^(2k+1), 2^(BI_MODEXP_MAX_WINDOW - 1) used at most
+    BigInt  *sq;          // base^2 while the table is built
+    BigInt  *y;           // NULL stands for 1 until the first multiply
+    size_t   nodd;
+    size_t   bits;
+    size_t   i;           // exponent bits [0, i) are still to be consumed
+    size_t   lo;          // current window is [lo, i)
+    uint32_t val;         // its value
+    unsigned w;           // window width
+    int      state;
+} BiModexpCtx;
+
+bool bi_modexp_start (BiModexpCtx *ctx, const BigInt *base, const BigInt *exp, const BigInt *mod);
+int  bi_modexp_step  (BiModexpCtx *ctx, size_t budget);
+void bi_modexp_finish(BiModexpCtx *ctx, BigInt **res);
 void bi_gcd(const BigInt *a, const BigInt *b, BigInt **res);      
 bool bi_modinv(const BigInt *a, const BigInt *m, BigInt **inv);// inv(a) mod m
+// out[i] = inv(values[i]) mod m for all i with one Euclid (Montgomery's trick);
+// out[i] is NULL where values[i] has no inverse. False only on error.
+bool bi_modinv_batch(const BigInt *const *values, size_t count, const BigInt *m, BigInt **out);
+
+/* Accumulator for sums of products (bi_acc.c). Limbs are kept in 64-bit
+ * slots with carries deferred, so a long run of bi_acc_muladd calls does
+ * one carry pass and one allocation at the end instead of a bi_mul plus
+ * bi_add per term. Nonnegative sums only.
+ */
+typedef struct {
+    size_t    len;        // slots in use
+    size_t    cap;
+    uint64_t *slots;      // slot i has weight 2^(32 i), not yet carried
+    uint64_t  headroom;   // additions each slot can still take
+} BiAcc;
+
+bool    bi_acc_init  (BiAcc *acc, size_t limbs);           // limbs: size hint, may be 0
+void    bi_acc_free  (BiAcc *acc);
+void    bi_acc_clear (BiAcc *acc);                         // back to zero, keeps the memory
+bool    bi_acc_add   (BiAcc *acc, const BigInt *a);        // acc += a
+bool    bi_acc_muladd(BiAcc *acc, const BigInt *a, const BigInt *b);  // acc += a * b
+BigInt *bi_acc_result(BiAcc *acc);                         // carried sum; acc stays usable
+
+/* Live copy of the tune.h thresholds. It starts out as the compiled-in
+ * values; only the tuner changes it, before any other thread runs.
+ */
+typedef struct {
+    size_t   karatsuba_limbs;       // bi_mul: Karatsuba from this operand size
+    uint32_t window_above[5];       // bi_modexp: window w+2 past [w] exponent bits;
+                                    // BI_MODEXP_MAX_WINDOW - 1 entries (tune.h)
+    size_t   bz_limbs;              // bi_divmod: Burnikel-Ziegler from this divisor size
+    size_t   newton_limbs;          // bi_divmod: Newton reciprocal + Barrett from here
+    size_t   ntt_limbs;             // bi_mul: three-prime NTT from this operand size
+    size_t   par_mul_limbs;         // bi_mul: split across the shared pool from here
+} BiTuning;
+extern BiTuning bi_tuning;
+
+BigInt *bi_from_bytes_be(const unsigned char *buf, size_t len);
+bool    bi_to_bytes_be(const BigInt *n, unsigned char *buf, size_t width); // zero-padded, false if n needs more than width bytes
+/* Memory for BigInt structs and limbs comes from a replaceable allocator
+ * (bi_alloc.c). Install one before the first BigInt is created; memory
+ * must be freed through the allocator that returned it. NULL restores
+ * the default, which counts per-thread usage readable with the
+ * bi_alloc_*_stats() calls (custom allocators keep their own books).
+ */
+typedef struct {
+    void *(*alloc)  (void *ctx, size_t size);            // need not zero
+    void *(*realloc)(void *ctx, void *p, size_t size);
+    void  (*free)   (void *ctx, void *p);
+    void  *ctx;
+} BiAllocator;
+
+typedef struct {
+    int64_t  live_bytes;   // per thread: may be negative if it frees others' memory
+    int64_t  peak_bytes;   // total: the largest per-thread peak
+    uint64_t allocs;       // allocations and growing reallocations
+    uint64_t frees;
+} BiAllocStats;
+
+void               bi_set_allocator(const BiAllocator *a);
+const BiAllocator *bi_get_allocator(void);
+void               bi_alloc_thread_stats(BiAllocStats *out);   // calling thread
+void               bi_alloc_total_stats(BiAllocStats *out);    // every thread so far
+
+void *bi_mem_alloc(size_t size);
+void *bi_mem_realloc(void *p, size_t size);
+void  bi_mem_free(void *p);
 
 void    bi_print_hex(const BigInt *n);                 
 bool    bi_write_hex(FILE *fp, const BigInt *n);      
 BigInt *bi_read_hex (FILE *fp);                        
+char   *bi_to_dec  (const BigInt *n);                  // decimal, free() the result
+BigInt *bi_from_dec(const char *s);                    // digits, surrounding whitespace allowed
 #endif 
\ No newline at end of file
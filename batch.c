@@ -0,0 +1,477 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+#include "rsa.h"
+#include "container.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Blocks per leaf task; larger ranges are split in half until they fit.
+#define BATCH_GRAIN 256
+
+typedef struct {
+    char     *in_path, *out_path;
+    bool      encrypt;
+    int       in_fd, out_fd;
+    CtHeader  hdr;
+    CtTrailer tr;
+    uint64_t  bytes;       // plaintext bytes handled
+    uint64_t  remaining;   // blocks not yet finished (atomic)
+    int       failed;      // (atomic)
+    double    t_start, t_end;
+} BatchFile;
+
+typedef struct {
+    BatchFile *f;
+    uint64_t   lo, hi;     // block range
+    bool       root;       // first task of a file: opens it and sets hi
+} Task;
+
+// Owner pushes and pops at the bottom, thieves take from the top, so the
+// owner keeps working on the small pieces it just split off while idle
+// workers walk away with the big ones.
+typedef struct {
+    pthread_mutex_t mu;
+    Task           *buf;
+    size_t          cap, head, count;
+} Deque;
+
+struct Batch;
+
+typedef struct {
+    struct Batch  *b;
+    Deque          dq;
+    uint32_t       seed;
+    unsigned char *in_buf, *out_buf;   // BATCH_GRAIN blocks each
+    pthread_t      tid;
+} Worker;
+
+typedef struct Batch {
+    RSAKey     pub, priv;
+    CtHeader   geo;
+    BatchFile *files;
+    size_t     nfiles;
+    Worker    *workers;
+    size_t     nworkers;
+    size_t     files_left;  // (atomic)
+    // Idle workers sleep on `work` until a task is pushed (bumping
+    // work_gen) or the last file finishes.
+    pthread_mutex_t idle_mu;
+    pthread_cond_t  work;
+    uint64_t        work_gen;
+    size_t          waiting;
+} Batch;
+
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static bool dq_push(Deque *d, Task t)
+{
+    pthread_mutex_lock(&d->mu);
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        Task *nb = malloc(cap * sizeof *nb);
+        if (!nb) { pthread_mutex_unlock(&d->mu); return false; }
+        for (size_t i = 0; i < d->count; ++i) nb[i] = d->buf[(d->head + i) % d->cap];
+        free(d->buf);
+        d->buf = nb; d->cap = cap; d->head = 0;
+    }
+    d->buf[(d->head + d->count++) % d->cap] = t;
+    pthread_mutex_unlock(&d->mu);
+    return true;
+}
+
+static bool dq_pop(Deque *d, Task *t)
+{
+    pthread_mutex_lock(&d->mu);
+    bool ok = d->count > 0;
+    if (ok) *t = d->buf[(d->head + --d->count) % d->cap];
+    pthread_mutex_unlock(&d->mu);
+    return ok;
+}
+
+static bool dq_steal(Deque *d, Task *t)
+{
+    pthread_mutex_lock(&d->mu);
+    bool ok = d->count > 0;
+    if (ok) {
+        *t = d->buf[d->head];
+        d->head = (d->head + 1) % d->cap;
+        d->count--;
+    }
+    pthread_mutex_unlock(&d->mu);
+    return ok;
+}
+
+static void wake_idle(Batch *b, bool all)
+{
+    pthread_mutex_lock(&b->idle_mu);
+    b->work_gen++;
+    if (b->waiting) {
+        if (all) pthread_cond_broadcast(&b->work);
+        else     pthread_cond_signal(&b->work);
+    }
+    pthread_mutex_unlock(&b->idle_mu);
+}
+
+static bool steal(Worker *w, Task *t)
+{
+    Batch *b = w->b;
+    w->seed ^= w->seed << 13; w->seed ^= w->seed >> 17; w->seed ^= w->seed << 5;
+    size_t start = w->seed % b->nworkers;
+    for (size_t i = 0; i < b->nworkers; ++i) {
+        Worker *v = &b->workers[(start + i) % b->nworkers];
+        if (v != w && dq_steal(&v->dq, t)) return true;
+    }
+    return false;
+}
+
+
+static bool pread_full(int fd, unsigned char *buf, size_t len, uint64_t off)
+{
+    uint64_t t0 = stats_now();
+    stats_add(ST_READ_BYTES, len);
+    while (len > 0) {
+        ssize_t r = pread(fd, buf, len, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r; len -= (size_t)r; off += (uint64_t)r;
+    }
+    stats_time(ST_READ_NS, t0);
+    return true;
+}
+
+static bool pwrite_full(int fd, const unsigned char *buf, size_t len, uint64_t off)
+{
+    uint64_t t0 = stats_now();
+    stats_add(ST_WRITE_BYTES, len);
+    while (len > 0) {
+        ssize_t r = pwrite(fd, buf, len, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r; len -= (size_t)r; off += (uint64_t)r;
+    }
+    stats_time(ST_WRITE_NS, t0);
+    return true;
+}
+
+// Opens both files and works out the block count. For encryption the
+// header is written here and the trailer once the last block is done.
+static bool file_open(Batch *b, BatchFile *f)
+{
+    f->t_start = now_sec();
+    f->in_fd = open(f->in_path, O_RDONLY);
+    if (f->in_fd < 0) { perror(f->in_path); return false; }
+    struct stat st;
+    if (fstat(f->in_fd, &st) != 0) { perror(f->in_path); return false; }
+    uint64_t size = (uint64_t)st.st_size;
+
+    if (f->encrypt) {
+        f->hdr = b->geo;
+        f->tr.nblocks  = (size + f->hdr.block_size - 1) / f->hdr.block_size;
+        f->tr.last_len = f->tr.nblocks ? (uint32_t)(size - (f->tr.nblocks - 1) * f->hdr.block_size) : 0;
+        f->bytes = size;
+    } else {
+        unsigned char raw_hdr[CT_HEADER_SIZE], raw_tr[CT_TRAILER_SIZE];
+        if (size < CT_HEADER_SIZE + CT_TRAILER_SIZE ||
+            !pread_full(f->in_fd, raw_hdr, sizeof raw_hdr, 0) ||
+            !pread_full(f->in_fd, raw_tr, sizeof raw_tr, size - CT_TRAILER_SIZE) ||
+            !ct_decode_header(raw_hdr, &f->hdr) || !ct_decode_trailer(raw_tr, &f->tr)) {
+            fprintf(stderr, "%s: not a binary ciphertext container.\n", f->in_path);
+            return false;
+        }
+        if (!ct_validate(&f->hdr, &f->tr, b->priv.n, size)) return false;
+        if (f->hdr.flags & CT_FLAG_LZ) {
+            // Blocks are written in parallel; the frame stream needs one serial pass
+            fprintf(stderr, "%s: compressed container, decrypt it with 'rsa_run dec'.\n", f->in_path);
+            return false;
+        }
+        f->bytes = ct_plain_size(&f->hdr, &f->tr);
+    }
+
+    f->out_fd = open(f->out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (f->out_fd < 0) { perror(f->out_path); return false; }
+    if (f->encrypt) {
+        unsigned char raw_hdr[CT_HEADER_SIZE];
+        ct_encode_header(raw_hdr, &f->hdr);
+        if (!pwrite_full(f->out_fd, raw_hdr, sizeof raw_hdr, 0)) { perror(f->out_path); return false; }
+    }
+    STORE(f->remaining, f->tr.nblocks);
+    return true;
+}
+
+static void file_finish(Batch *b, BatchFile *f)
+{
+    if (f->encrypt && !LOAD(f->failed)) {
+        unsigned char raw_tr[CT_TRAILER_SIZE];
+        ct_encode_trailer(raw_tr, &f->tr);
+        if (!pwrite_full(f->out_fd, raw_tr, sizeof raw_tr, ct_block_offset(&f->hdr, f->tr.nblocks))) {
+            perror(f->out_path);
+            STORE(f->failed, 1);
+        }
+    }
+    // Only an output this job created or truncated may be removed: a file
+    // that failed before that point leaves whatever was there untouched.
+    bool created = f->out_fd >= 0;
+    if (created && close(f->out_fd) != 0) { perror(f->out_path); STORE(f->failed, 1); }
+    if (f->in_fd >= 0) close(f->in_fd);
+    f->in_fd = f->out_fd = -1;
+
+    struct stat st;
+    if (created && LOAD(f->failed) && stat(f->out_path, &st) == 0 && S_ISREG(st.st_mode)) remove(f->out_path);
+    f->t_end = now_sec();
+    if (__atomic_sub_fetch(&b->files_left, 1, __ATOMIC_SEQ_CST) == 0) wake_idle(b, true);
+}
+
+static bool run_range(Worker *w, BatchFile *f, uint64_t lo, uint64_t hi)
+{
+    const CtHeader *h = &f->hdr;
+    Batch *b = w->b;
+    uint64_t plain_lo = lo * h->block_size;
+    size_t plain_len = 0;
+    for (uint64_t i = lo; i < hi; ++i) plain_len += ct_block_len(h, &f->tr, i);
+    size_t cipher_len = (size_t)(hi - lo) * h->mod_bytes;
+
+    if (f->encrypt) {
+        if (!pread_full(f->in_fd, w->in_buf, plain_len, plain_lo)) {
+            fprintf(stderr, "%s: read failed.\n", f->in_path); return false;
+        }
+        const unsigned char *p = w->in_buf;
+        for (uint64_t i = lo; i < hi; ++i) {
+            size_t n = ct_block_len(h, &f->tr, i);
+            BigInt *m = bi_from_bytes_be(p, n), *c = NULL;
+            if (m) rsa_encrypt(m, &b->pub, &c);
+            bool ok = c && bi_to_bytes_be(c, w->out_buf + (i - lo) * h->mod_bytes, h->mod_bytes);
+            bi_free(m); bi_free(c);
+            if (!ok) { fprintf(stderr, "%s: encryption failed at block %llu.\n", f->in_path, (unsigned long long)i); return false; }
+            p += n;
+        }
+        if (!pwrite_full(f->out_fd, w->out_buf, cipher_len, ct_block_offset(h, lo))) {
+            perror(f->out_path); return false;
+        }
+    } else {
+        if (!pread_full(f->in_fd, w->in_buf, cipher_len, ct_block_offset(h, lo))) {
+            fprintf(stderr, "%s: read failed.\n", f->in_path); return false;
+        }
+        unsigned char *p = w->out_buf;
+        for (uint64_t i = lo; i < hi; ++i) {
+            size_t n = ct_block_len(h, &f->tr, i);
+            BigInt *c = bi_from_bytes_be(w->in_buf + (i - lo) * h->mod_bytes, h->mod_bytes), *m = NULL;
+            if (c) rsa_decrypt(c, &b->priv, &m);
+            bool ok = m && bi_to_bytes_be(m, p, n);
+            bi_free(c); bi_free(m);
+            if (!ok) { fprintf(stderr, "%s: decryption failed at block %llu.\n", f->in_path, (unsigned long long)i); return false; }
+            p += n;
+        }
+        if (!pwrite_full(f->out_fd, w->out_buf, plain_len, plain_lo)) {
+            perror(f->out_path); return false;
+        }
+    }
+    return true;
+}
+
+static void run_task(Worker *w, Task t)
+{
+    BatchFile *f = t.f;
+    if (t.root) {
+        if (!file_open(w->b, f)) { STORE(f->failed, 1); file_finish(w->b, f); return; }
+        if (f->tr.nblocks == 0) { file_finish(w->b, f); return; }
+        t.hi = f->tr.nblocks;
+    }
+    // Keep the first half, offer the rest to thieves.
+    while (t.hi - t.lo > BATCH_GRAIN) {
+        uint64_t mid = t.lo + (t.hi - t.lo) / 2;
+        Task rest = { f, mid, t.hi, false };
+        if (!dq_push(&w->dq, rest)) break;
+        wake_idle(w->b, false);
+        t.hi = mid;
+    }
+    // A range that could not be split runs in grain-sized pieces.
+    for (uint64_t lo = t.lo; lo < t.hi; lo += BATCH_GRAIN) {
+        uint64_t hi = (t.hi - lo > BATCH_GRAIN) ? lo + BATCH_GRAIN : t.hi;
+        if (!LOAD(f->failed) && !run_range(w, f, lo, hi)) STORE(f->failed, 1);
+    }
+    if (__atomic_sub_fetch(&f->remaining, t.hi - t.lo, __ATOMIC_SEQ_CST) == 0) file_finish(w->b, f);
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *w = arg;
+    Batch *b = w->b;
+    Task t;
+    for (;;) {
+        // Read the generation before looking for work: a push that lands
+        // after the failed steal changes it, so the wait below cannot miss it.
+        pthread_mutex_lock(&b->idle_mu);
+        uint64_t gen = b->work_gen;
+        pthread_mutex_unlock(&b->idle_mu);
+        if (dq_pop(&w->dq, &t) || steal(w, &t)) { run_task(w, t); continue; }
+
+        pthread_mutex_lock(&b->idle_mu);
+        while (b->work_gen == gen && LOAD(b->files_left) != 0) {
+            b->waiting++;
+            pthread_cond_wait(&b->work, &b->idle_mu);
+            b->waiting--;
+        }
+        bool done = LOAD(b->files_left) == 0;
+        pthread_mutex_unlock(&b->idle_mu);
+        if (done) break;
+    }
+    return NULL;
+}
+
+
+static bool parse_manifest(const char *path, Batch *b)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) { perror(path); return false; }
+    char *line = NULL;
+    size_t cap = 0, alloc = 0, lineno = 0;
+    bool ok = true;
+    while (ok && getline(&line, &cap, fp) != -1) {
+        ++lineno;
+        char mode[8], in[4096], out[4096], extra;
+        char *s = line;
+        while (*s == ' ' || *s == '\t') ++s;
+        if (*s == '\0' || *s == '\n' || *s == '#') continue;
+        if (sscanf(s, "%7s %4095s %4095s %c", mode, in, out, &extra) != 3 ||
+            (strcmp(mode, "enc") != 0 && strcmp(mode, "dec") != 0)) {
+            fprintf(stderr, "%s:%zu: expected 'enc|dec <input> <output>'.\n", path, lineno);
+            ok = false; break;
+        }
+        if (b->nfiles == alloc) {
+            alloc = alloc ? alloc * 2 : 16;
+            BatchFile *nf = realloc(b->files, alloc * sizeof *nf);
+            if (!nf) { perror("realloc manifest"); ok = false; break; }
+            b->files = nf;
+        }
+        BatchFile *f = &b->files[b->nfiles];
+        memset(f, 0, sizeof *f);
+        f->in_fd = f->out_fd = -1;
+        f->encrypt  = mode[0] == 'e';
+        f->in_path  = strdup(in);
+        f->out_path = strdup(out);
+        b->nfiles++;
+        if (!f->in_path || !f->out_path) { perror("strdup"); ok = false; }
+    }
+    free(line);
+    fclose(fp);
+    return ok;
+}
+
+static bool batch_keys(Batch *b)
+{
+    if (access("public.key", F_OK) != 0 && access("private.key", F_OK) != 0) {
+        rsa_generate_keypair(&b->pub, &b->priv, 64);
+        if (!rsa_save_key("public.key", &b->pub, "PUBLIC") ||
+            !rsa_save_key("private.key", &b->priv, "PRIVATE")) {
+            fprintf(stderr, "Error saving key pair.\n");
+            return false;
+        }
+    } else if (!rsa_load_key("public.key", &b->pub) || !rsa_load_key("private.key", &b->priv)) {
+        return false;
+    }
+    if (!b->pub.n || !b->priv.n || bi_cmp(b->pub.n, b->priv.n) != 0 || bi_bitlen(b->pub.n) <= 8) {
+        fprintf(stderr, "Error: public.key and private.key do not form a usable pair.\n");
+        return false;
+    }
+    ct_header_init(&b->geo, b->pub.n);
+    return true;
+}
+
+static void report(const Batch *b, double wall)
+{
+    uint64_t total = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < b->nfiles; ++i) {
+        const BatchFile *f = &b->files[i];
+        double secs = f->t_end - f->t_start;
+        if (f->failed) {
+            printf("FAILED  %s %s -> %s\n", f->encrypt ? "enc" : "dec", f->in_path, f->out_path);
+            failed++;
+            continue;
+        }
+        total += f->bytes;
+        printf("ok      %s %s -> %s  %llu bytes  %.3f s  %.1f KB/s\n",
+               f->encrypt ? "enc" : "dec", f->in_path, f->out_path, (unsigned long long)f->bytes,
+               secs, secs > 0 ? f->bytes / secs / 1e3 : 0.0);
+    }
+    printf("total   %zu files (%zu failed)  %llu bytes  %.3f s  %.1f KB/s\n",
+           b->nfiles, failed, (unsigned long long)total, wall, wall > 0 ? total / wall / 1e3 : 0.0);
+}
+
+int batch_run(const char *manifest, size_t nthreads)
+{
+    Batch b = {0};
+    int rc = 1;
+    pthread_mutex_init(&b.idle_mu, NULL);
+    pthread_cond_init(&b.work, NULL);
+    if (!parse_manifest(manifest, &b) || !batch_keys(&b)) goto out;
+
+    size_t stride = b.geo.mod_bytes > b.geo.block_size ? b.geo.mod_bytes : b.geo.block_size;
+    b.nworkers = nthreads ? nthreads : 1;
+    b.workers  = calloc(b.nworkers, sizeof *b.workers);
+    if (!b.workers) { perror("calloc workers"); goto out; }
+    for (size_t i = 0; i < b.nworkers; ++i) {
+        Worker *w = &b.workers[i];
+        w->b = &b;
+        w->seed = (uint32_t)(2654435761u * (i + 1));
+        pthread_mutex_init(&w->dq.mu, NULL);
+        w->in_buf  = malloc(BATCH_GRAIN * stride);
+        w->out_buf = malloc(BATCH_GRAIN * stride);
+        if (!w->in_buf || !w->out_buf) { perror("malloc worker buffers"); goto out; }
+    }
+    // Deal the files out round-robin; stealing evens out the rest.
+    for (size_t i = 0; i < b.nfiles; ++i) {
+        Task t = { &b.files[i], 0, 0, true };
+        if (!dq_push(&b.workers[i % b.nworkers].dq, t)) { perror("malloc task queue"); goto out; }
+    }
+    b.files_left = b.nfiles;
+
+    double t0 = now_sec();
+    size_t started = 1;
+    for (; started < b.nworkers; ++started) {
+        if (pthread_create(&b.workers[started].tid, NULL, worker_main, &b.workers[started]) != 0) {
+            fprintf(stderr, "Warning: could only start %zu of %zu threads.\n", started, b.nworkers);
+            break;
+        }
+    }
+    worker_main(&b.workers[0]);
+    for (size_t i = 1; i < started; ++i) pthread_join(b.workers[i].tid, NULL);
+    double wall = now_sec() - t0;
+
+    report(&b, wall);
+    rc = 0;
+    for (size_t i = 0; i < b.nfiles; ++i) if (b.files[i].failed) rc = 1;
+
+out:
+    for (size_t i = 0; b.workers && i < b.nworkers; ++i) {
+        Worker *w = &b.workers[i];
+        free(w->dq.buf); free(w->in_buf); free(w->out_buf);
+        if (w->b) pthread_mutex_destroy(&w->dq.mu);
+    }
+    free(b.workers);
+    for (size_t i = 0; i < b.nfiles; ++i) { free(b.files[i].in_path); free(b.files[i].out_path); }
+    free(b.files);
+    rsa_free_key(&b.pub);
+    rsa_free_key(&b.priv);
+    pthread_cond_destroy(&b.work);
+    pthread_mutex_destroy(&b.idle_mu);
+    return rc;
+}
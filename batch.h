@@ -0,0 +1,22 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <stddef.h>
+
+/* Batch mode: encrypt or decrypt many files in one process.
+ *
+ * The manifest has one job per line,
+ *     enc <input> <output>
+ *     dec <input> <output>
+ * Blank lines and lines starting with '#' are ignored; paths may not
+ * contain whitespace. Ciphertext is always the binary container (see
+ * container.h). Keys are read from public.key / private.key and created
+ * first if neither exists.
+ *
+ * Every file is cut into block-range tasks that `nthreads` workers share
+ * through per-worker deques with stealing, so one large file is spread
+ * over all workers while small ones fill the gaps. Per-file and overall
+ * throughput is printed to stdout. Returns 0 if every job succeeded.
+ */
+int batch_run(const char *manifest, size_t nthreads);
+
+#endif
@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include "bench_util.h"
+#include "rsa.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Microbenchmarks for the BigInt and RSA primitives, plus end-to-end
+ * rsa_run file throughput.
+ *
+ * Every case is warmed up, then timed as `reps` samples. A sample runs
+ * the operation enough times to last at least MIN_SAMPLE_NS, so fast
+ * operations are not lost in timer noise; per-operation times are
+ * reported as median, p99 and mean, and ops/s is taken from the median.
+ *
+ * RSA cases use synthetic keys: a random odd modulus of the given size,
+ * e = 65537 and a full-size private exponent. Without CRT that costs
+ * exactly what a real key of that size would, and avoids prime search.
+ *
+ * Results are written as JSON, one case per line, which is also the
+ * format read back by --baseline.
+ */
+
+#define MIN_SAMPLE_NS   200000.0
+#define MAX_CASES       128
+
+typedef struct {
+    size_t      reps;
+    size_t      warmup;
+    double      max_seconds;    // per case, stop sampling early past this
+    size_t      min_bits, max_bits;
+    size_t      max_exp_bits;   // cap for modexp / modinv / rsa_decrypt sizes
+    size_t      file_bytes;     // 0 = skip the rsa_run cases
+    size_t      threads;        // -j for the rsa_run cases
+    const char *rsa_run;
+    const char *json_path;      // NULL = stdout
+    const char *baseline;
+    double      threshold;      // % slowdown reported as a regression
+    const char *only;           // run cases whose name contains this
+} BenchOpts;
+
+typedef struct {
+    char   name[32];
+    size_t bits;
+    size_t iters;               // operations per sample
+    size_t samples;
+    double median_ns, p99_ns, mean_ns;
+    double bytes_per_sec;       // file cases only
+} Result;
+
+typedef struct {
+    BigInt *a, *b, *m, *e;
+    RSAKey  pub, priv;
+} Operands;
+
+typedef void (*BenchFn)(const Operands *o);
+
+static void run_mul(const Operands *o)    { BigInt *r = NULL; bi_mul(o->a, o->b, &r); bi_free(r); }
+static void run_sqr(const Operands *o)    { BigInt *r = NULL; bi_mul(o->a, o->a, &r); bi_free(r); }
+static void run_divmod(const Operands *o)
+{
+    BigInt *q = NULL, *r = NULL, *wide = NULL;
+    bi_mul(o->a, o->b, &wide);          // 2n-bit dividend, n-bit divisor
+    bi_divmod(wide, o->m, &q, &r);
+    bi_free(q); bi_free(r); bi_free(wide);
+}
+// Sum of eight products of the operands: bi_mul + bi_add per term against
+// the carry-save accumulator.
+#define DOT_TERMS 8
+#define DOT_PAIR(o, k) ((const BigInt *[]){ (o)->a, (o)->b, (o)->m, (o)->e }[(k) % 4])
+static void run_dot(const Operands *o)
+{
+    BigInt *sum = bi_from_u64(0);
+    for (int k = 0; k < DOT_TERMS && sum; ++k) {
+        BigInt *p = NULL, *s = NULL;
+        bi_mul(DOT_PAIR(o, k), DOT_PAIR(o, k / 4 + k + 1), &p);
+        if (p) bi_add(sum, p, &s);
+        bi_free(p); bi_free(sum);
+        sum = s;
+    }
+    bi_free(sum);
+}
+static void run_acc_dot(const Operands *o)
+{
+    BiAcc acc;
+    bi_acc_init(&acc, 2 * o->m->len + 1);
+    for (int k = 0; k < DOT_TERMS; ++k)
+        bi_acc_muladd(&acc, DOT_PAIR(o, k), DOT_PAIR(o, k / 4 + k + 1));
+    bi_free(bi_acc_result(&acc));
+    bi_acc_free(&acc);
+}
+static void run_modexp(const Operands *o) { BigInt *r = NULL; bi_modexp(o->a, o->e, o->m, &r); bi_free(r); }
+// The same exponentiation in slices of STEP_BUDGET multiplications, as
+// an event loop would run it; the difference is the cost of resuming.
+#define STEP_BUDGET 16
+static void run_modexp_step(const Operands *o)
+{
+    BiModexpCtx ctx;
+    BigInt *r = NULL;
+    if (bi_modexp_start(&ctx, o->a, o->e, o->m))
+        while (bi_modexp_step(&ctx, STEP_BUDGET) == 1) {}
+    bi_modexp_finish(&ctx, &r);
+    bi_free(r);
+}
+// One exponentiation over PEXP_THREADS threads of the shared pool; only
+// faster than bi_modexp when that many cores are idle.
+#define PEXP_THREADS 4
+static void run_modexp_par(const Operands *o)
+{
+    BigInt *r = NULL;
+    bi_modexp_par(o->a, o->e, o->m, PEXP_THREADS, &r);
+    bi_free(r);
+}
+static void run_modinv(const Operands *o) { BigInt *r = NULL; bi_modinv(o->a, o->m, &r); bi_free(r); }
+// Eight inverses mod m one at a time against Montgomery's trick. Only
+// a is known to be invertible, and the values do not change the cost.
+#define INV_COUNT 8
+static void run_modinv8(const Operands *o)
+{
+    for (int k = 0; k < INV_COUNT; ++k) { BigInt *r = NULL; bi_modinv(o->a, o->m, &r); bi_free(r); }
+}
+static void run_modinv_batch8(const Operands *o)
+{
+    const BigInt *v[INV_COUNT];
+    BigInt *r[INV_COUNT];
+    for (int k = 0; k < INV_COUNT; ++k) v[k] = o->a;
+    if (bi_modinv_batch(v, INV_COUNT, o->m, r))
+        for (int k = 0; k < INV_COUNT; ++k) bi_free(r[k]);
+}
+static void run_rsa_enc(const Operands *o) { BigInt *r = NULL; rsa_encrypt(o->a, &o->pub, &r); bi_free(r); }
+static void run_rsa_dec(const Operands *o) { BigInt *r = NULL; rsa_decrypt(o->a, &o->priv, &r); bi_free(r); }
+
+typedef struct {
+    const char *name;
+    BenchFn     fn;
+    bool        exp_heavy;      // cost grows with the full exponent size
+} Case;
+
+static const Case CASES[] = {
+    { "bi_mul",      run_mul,     false },
+    { "bi_sqr",      run_sqr,     false },
+    { "bi_dot8",     run_dot,     false },
+    { "bi_acc_dot8", run_acc_dot, false },
+    { "bi_divmod",   run_divmod,  false },
+    { "bi_modexp",   run_modexp,  true  },
+    { "bi_modexp_s16", run_modexp_step, true },
+    { "bi_modexp_p4", run_modexp_par, true },
+    { "bi_modinv",   run_modinv,  true  },
+    { "bi_modinv8",  run_modinv8, true  },
+    { "bi_modinv_b8", run_modinv_batch8, true },
+    { "rsa_encrypt", run_rsa_enc, false },
+    { "rsa_decrypt", run_rsa_dec, true  },
+};
+
+static void operands_init(Operands *o, size_t bits)
+{
+    o->m = bench_random_bits(bits, true);
+    o->e = bench_random_bits(bits, false);
+    // Keep a < m so every case sees a reduced operand.
+    o->a = bench_random_bits(bits - 1, false);
+    o->b = bench_random_bits(bits - 1, false);
+    // bi_modinv needs gcd(a, m) = 1; redraw a until it is invertible.
+    for (int tries = 0; tries < 64; ++tries) {
+        BigInt *inv = NULL;
+        bool ok = bi_modinv(o->a, o->m, &inv);
+        bi_free(inv);
+        if (ok) break;
+        bi_free(o->a);
+        o->a = bench_random_bits(bits - 1, false);
+    }
+    o->pub.n   = o->m;  o->pub.exp  = bi_from_u64(65537);
+    o->priv.n  = o->m;  o->priv.exp = o->e;
+}
+
+static void operands_free(Operands *o)
+{
+    bi_free(o->a); bi_free(o->b); bi_free(o->m); bi_free(o->e);
+    bi_free(o->pub.exp);
+}
+
+static void summarize(Result *r, double *samples, size_t n)
+{
+    qsort(samples, n, sizeof *samples, bench_cmp_double);
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += samples[i];
+    size_t p99 = (size_t)(0.99 * (n - 1) + 0.5);
+    r->samples   = n;
+    r->median_ns = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    r->p99_ns    = samples[p99];
+    r->mean_ns   = sum / n;
+}
+
+typedef struct {
+    const Case     *c;
+    const Operands *o;
+} CaseCall;
+
+static void call_case(void *ctx)
+{
+    const CaseCall *cc = ctx;
+    cc->c->fn(cc->o);
+}
+
+static void time_case(const BenchOpts *opt, const Case *c, const Operands *o, size_t bits, Result *r)
+{
+    double *samples = malloc(opt->reps * sizeof *samples);
+    if (!samples) { fprintf(stderr, "Error: out of memory.\n"); exit(1); }
+
+    // Warm up, and size a sample from the slowest warmup call.
+    CaseCall cc = { c, o };
+    double one = 0;
+    for (size_t i = 0; i < opt->warmup || i == 0; ++i) {
+        double dt = bench_sample(call_case, &cc, 1);
+        if (dt > one) one = dt;
+    }
+    size_t iters = bench_iters(one, MIN_SAMPLE_NS);
+
+    double start = bench_now_ns();
+    size_t n = 0;
+    while (n < opt->reps) {
+        samples[n++] = bench_sample(call_case, &cc, iters);
+        if (n >= 3 && (bench_now_ns() - start) / 1e9 > opt->max_seconds) break;
+    }
+    snprintf(r->name, sizeof r->name, "%s", c->name);
+    r->bits  = bits;
+    r->iters = iters;
+    r->bytes_per_sec = 0;
+    summarize(r, samples, n);
+    free(samples);
+}
+
+
+static bool write_random_file(const char *path, size_t bytes)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) { perror(path); return false; }
+    unsigned char buf[4096];
+    for (size_t done = 0; done < bytes;) {
+        size_t n = bytes - done < sizeof buf ? bytes - done : sizeof buf;
+        for (size_t i = 0; i < n; ++i) buf[i] = (unsigned char)bench_rng_next();
+        if (fwrite(buf, 1, n, fp) != n) { perror(path); fclose(fp); return false; }
+        done += n;
+    }
+    return fclose(fp) == 0;
+}
+
+// Times whole rsa_run invocations on a generated file. Key generation
+// is part of every 'enc' run, exactly as a user would see it.
+static size_t file_cases(const BenchOpts *opt, Result *out)
+{
+    // The runs happen in a temp directory, so make the binary path absolute.
+    char exe[4096], cwd[2048];
+    if (opt->rsa_run[0] == '/') {
+        snprintf(exe, sizeof exe, "%s", opt->rsa_run);
+    } else if (getcwd(cwd, sizeof cwd)) {
+        snprintf(exe, sizeof exe, "%s/%s", cwd, opt->rsa_run);
+    } else {
+        perror("getcwd"); return 0;
+    }
+    if (access(exe, X_OK) != 0) { perror(exe); return 0; }
+    char dir[] = "/tmp/rsa_bench.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 0; }
+    char plain[64], cipher[64], back[64], cmd[8192];
+    snprintf(plain,  sizeof plain,  "%s/plain",  dir);
+    snprintf(cipher, sizeof cipher, "%s/cipher", dir);
+    snprintf(back,   sizeof back,   "%s/back",   dir);
+
+    size_t n = 0;
+    if (write_random_file(plain, opt->file_bytes)) {
+        const char *modes[2][3] = { { "rsa_run_enc", plain, cipher }, { "rsa_run_dec", cipher, back } };
+        for (int k = 0; k < 2; ++k) {
+            // Runs in the temp directory so the key files land there too.
+            snprintf(cmd, sizeof cmd, "cd %s && %s -j %zu %s %s %s > /dev/null",
+                     dir, exe, opt->threads, k == 0 ? "enc" : "dec", modes[k][1], modes[k][2]);
+            size_t reps = opt->reps < 3 ? opt->reps : 3;
+            double samples[3];
+            size_t got = 0;
+            for (size_t i = 0; i < reps; ++i) {
+                double t0 = bench_now_ns();
+                if (system(cmd) != 0) { fprintf(stderr, "Error: '%s' failed.\n", cmd); break; }
+                samples[got++] = bench_now_ns() - t0;
+            }
+            if (got == 0) break;
+            Result *r = &out[n++];
+            snprintf(r->name, sizeof r->name, "%s", modes[k][0]);
+            r->bits  = opt->file_bytes;
+            r->iters = 1;
+            summarize(r, samples, got);
+            r->bytes_per_sec = opt->file_bytes / (r->median_ns / 1e9);
+        }
+    }
+    snprintf(cmd, sizeof cmd, "rm -rf %s", dir);
+    if (system(cmd) != 0) fprintf(stderr, "Warning: could not remove %s.\n", dir);
+    return n;
+}
+
+
+static void write_json(FILE *fp, const BenchOpts *opt, const Result *r, size_t n)
+{
+    fprintf(fp, "{\n  \"reps\": %zu, \"warmup\": %zu, \"file_bytes\": %zu, \"threads\": %zu,\n  \"results\": [\n",
+            opt->reps, opt->warmup, opt->file_bytes, opt->threads);
+    for (size_t i = 0; i < n; ++i) {
+        // "bits" is the file size in bytes for the rsa_run cases.
+        fprintf(fp, "    {\"name\": \"%s\", \"bits\": %zu, \"median_ns\": %.1f, \"p99_ns\": %.1f, "
+                    "\"mean_ns\": %.1f, \"ops_per_sec\": %.3f, \"bytes_per_sec\": %.1f, "
+                    "\"samples\": %zu, \"iters\": %zu}%s\n",
+                r[i].name, r[i].bits, r[i].median_ns, r[i].p99_ns, r[i].mean_ns,
+                1e9 / r[i].median_ns, r[i].bytes_per_sec, r[i].samples, r[i].iters,
+                i + 1 < n ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+static void print_table(const Result *r, size_t n)
+{
+    fprintf(stderr, "%-14s %8s %14s %14s %14s\n", "case", "bits", "median", "p99", "ops/s");
+    for (size_t i = 0; i < n; ++i) {
+        fprintf(stderr, "%-14s %8zu %12.3fus %12.3fus %14.1f", r[i].name, r[i].bits,
+                r[i].median_ns / 1e3, r[i].p99_ns / 1e3, 1e9 / r[i].median_ns);
+        if (r[i].bytes_per_sec > 0) fprintf(stderr, "   %.1f KB/s", r[i].bytes_per_sec / 1e3);
+        fputc('\n', stderr);
+    }
+}
+
+// Compares medians against a file written by an earlier run. Returns the
+// number of cases that got slower by more than the threshold.
+static int compare_baseline(const BenchOpts *opt, const Result *r, size_t n)
+{
+    FILE *fp = fopen(opt->baseline, "r");
+    if (!fp) { perror(opt->baseline); return -1; }
+    char line[1024];
+    int regressions = 0;
+    fprintf(stderr, "\n%-14s %8s %14s %14s %9s\n", "case", "bits", "baseline", "now", "change");
+    while (fgets(line, sizeof line, fp)) {
+        char name[32];
+        size_t bits;
+        double median;
+        if (sscanf(line, " {\"name\": \"%31[^\"]\", \"bits\": %zu, \"median_ns\": %lf", name, &bits, &median) != 3) continue;
+        for (size_t i = 0; i < n; ++i) {
+            if (strcmp(r[i].name, name) != 0 || r[i].bits != bits) continue;
+            double change = (r[i].median_ns / median - 1) * 100;
+            bool worse = change > opt->threshold;
+            regressions += worse;
+            fprintf(stderr, "%-14s %8zu %12.3fus %12.3fus %+8.1f%%%s\n", name, bits, median / 1e3,
+                    r[i].median_ns / 1e3, change, worse ? "  REGRESSION" : "");
+        }
+    }
+    fclose(fp);
+    return regressions;
+}
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --reps N           timed samples per case (default 15)\n"
+            "  --warmup N         untimed runs before sampling (default 2)\n"
+            "  --max-seconds S    stop sampling a case after S seconds (default 2)\n"
+            "  --bits LO:HI       operand sizes, doubling from LO (default 512:8192)\n"
+            "  --max-exp-bits N   largest size for modexp/modinv/rsa_decrypt (default 4096)\n"
+            "  --file-bytes N     rsa_run enc/dec on an N-byte file, 0 to skip (default 16384)\n"
+            "  -j N               threads for the rsa_run cases (default 1)\n"
+            "  --rsa-run PATH     rsa_run binary (default ./rsa_run)\n"
+            "  --only NAME        run only cases whose name contains NAME\n"
+            "  --json FILE        write results to FILE instead of stdout\n"
+            "  --baseline FILE    compare with an earlier --json file\n"
+            "  --threshold PCT    slowdown reported as a regression (default 10)\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    BenchOpts opt = { 15, 2, 2.0, 512, 8192, 4096, 16384, 1, "./rsa_run", NULL, NULL, 10.0, NULL };
+
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) { usage(argv[0]); return 0; }
+        if (!v) { usage(argv[0]); return 1; }
+        ++i;
+        if      (strcmp(a, "--reps") == 0)         opt.reps = strtoul(v, NULL, 10);
+        else if (strcmp(a, "--warmup") == 0)       opt.warmup = strtoul(v, NULL, 10);
+        else if (strcmp(a, "--max-seconds") == 0)  opt.max_seconds = strtod(v, NULL);
+        else if (strcmp(a, "--max-exp-bits") == 0) opt.max_exp_bits = strtoul(v, NULL, 10);
+        else if (strcmp(a, "--file-bytes") == 0)   opt.file_bytes = strtoul(v, NULL, 10);
+        else if (strcmp(a, "-j") == 0)             opt.threads = strtoul(v, NULL, 10);
+        else if (strcmp(a, "--rsa-run") == 0)      opt.rsa_run = v;
+        else if (strcmp(a, "--only") == 0)         opt.only = v;
+        else if (strcmp(a, "--json") == 0)         opt.json_path = v;
+        else if (strcmp(a, "--baseline") == 0)     opt.baseline = v;
+        else if (strcmp(a, "--threshold") == 0)    opt.threshold = strtod(v, NULL);
+        else if (strcmp(a, "--bits") == 0) {
+            if (sscanf(v, "%zu:%zu", &opt.min_bits, &opt.max_bits) != 2) { usage(argv[0]); return 1; }
+        } else { usage(argv[0]); return 1; }
+    }
+    if (opt.reps == 0 || opt.threads == 0 || opt.min_bits < 64 || opt.max_bits < opt.min_bits) {
+        usage(argv[0]); return 1;
+    }
+
+    pool_shared_set_threads(PEXP_THREADS);
+
+    Result results[MAX_CASES];
+    size_t n = 0;
+    for (size_t bits = opt.min_bits; bits <= opt.max_bits; bits *= 2) {
+        Operands o;
+        operands_init(&o, bits);
+        for (size_t c = 0; c < sizeof CASES / sizeof CASES[0] && n < MAX_CASES; ++c) {
+            if (opt.only && !strstr(CASES[c].name, opt.only)) continue;
+            if (CASES[c].exp_heavy && bits > opt.max_exp_bits) continue;
+            time_case(&opt, &CASES[c], &o, bits, &results[n++]);
+        }
+        operands_free(&o);
+    }
+    // The decrypt case needs the encrypt output, so they run as a pair.
+    bool want_file = !opt.only || strstr("rsa_run_enc rsa_run_dec", opt.only);
+    if (opt.file_bytes > 0 && want_file && n + 2 <= MAX_CASES) n += file_cases(&opt, results + n);
+
+    print_table(results, n);
+    FILE *out = stdout;
+    if (opt.json_path && !(out = fopen(opt.json_path, "w"))) { perror(opt.json_path); return 1; }
+    write_json(out, &opt, results, n);
+    if (out != stdout && fclose(out) != 0) { perror(opt.json_path); return 1; }
+
+    if (opt.baseline) {
+        int reg = compare_baseline(&opt, results, n);
+        if (reg < 0) return 1;
+        if (reg > 0) { fprintf(stderr, "%d case(s) regressed by more than %.1f%%.\n", reg, opt.threshold); return 2; }
+    }
+    return 0;
+}
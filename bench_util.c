@@ -0,0 +1,53 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+uint64_t bench_rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+BigInt *bench_random_bits(size_t bits, bool odd)
+{
+    size_t limbs = (bits + 31) / 32;
+    BigInt *x = bi_new(limbs);
+    if (!x) { fprintf(stderr, "Error: out of memory.\n"); exit(1); }
+    for (size_t i = 0; i < limbs; ++i) x->limbs[i] = (uint32_t)bench_rng_next();
+    size_t top = (bits - 1) % 32;
+    x->limbs[limbs - 1] &= (top == 31) ? 0xFFFFFFFFu : ((1u << (top + 1)) - 1);
+    x->limbs[limbs - 1] |= 1u << top;
+    if (odd) x->limbs[0] |= 1;
+    return x;
+}
+
+double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+size_t bench_iters(double one_ns, double min_ns)
+{
+    return (one_ns >= min_ns) ? 1 : (size_t)(min_ns / (one_ns > 1 ? one_ns : 1)) + 1;
+}
+
+double bench_sample(TimedFn fn, void *ctx, size_t iters)
+{
+    double t0 = bench_now_ns();
+    for (size_t i = 0; i < iters; ++i) fn(ctx);
+    return (bench_now_ns() - t0) / iters;
+}
@@ -0,0 +1,27 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+#include "BigInt.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Timing and operand helpers shared by rsa_bench (bench.c), rsa_tune
+ * (tune.c) and rsa_check (bi_check.c). Operands come from a fixed-seed
+ * xorshift generator, so every run of a tool sees the same numbers.
+ */
+typedef void (*TimedFn)(void *ctx);
+
+uint64_t bench_rng_next(void);
+// A random number of exactly `bits` bits; exits on allocation failure.
+BigInt  *bench_random_bits(size_t bits, bool odd);
+
+double   bench_now_ns(void);
+// qsort comparator for doubles, ascending.
+int      bench_cmp_double(const void *a, const void *b);
+
+// Calls per sample so that a sample lasts at least min_ns, given that one
+// call took one_ns.
+size_t   bench_iters(double one_ns, double min_ns);
+// Nanoseconds per call, averaged over `iters` back-to-back calls.
+double   bench_sample(TimedFn fn, void *ctx, size_t iters);
+
+#endif
@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include "stats.h"
+#include <string.h>
+
+/* Carry-save accumulator.
+ *
+ * Slot i holds a partial sum of weight 2^(32 i) that may exceed 32 bits.
+ * Everything added to a slot is below 2^32, so a slot that starts below
+ * 2^32 takes 2^32 - 1 additions before it can overflow. `headroom` counts
+ * what is left, and a carry pass runs only when an add would use up more
+ * than that: in practice once, in bi_acc_result.
+ */
+
+static bool acc_reserve(BiAcc *acc, size_t len)
+{
+    if (len <= acc->cap) {
+        if (len > acc->len) acc->len = len;
+        return true;
+    }
+    size_t cap = acc->cap ? acc->cap : 8;
+    while (cap < len) cap *= 2;
+    uint64_t *s = bi_mem_realloc(acc->slots, cap * sizeof *s);
+    if (!s) return false;
+    memset(s + acc->cap, 0, (cap - acc->cap) * sizeof *s);
+    acc->slots = s;
+    acc->cap   = cap;
+    acc->len   = len;
+    return true;
+}
+
+// One carry pass: afterwards every slot is below 2^32.
+static bool acc_normalize(BiAcc *acc)
+{
+    uint64_t carry = 0;
+    for (size_t i = 0; i < acc->len; ++i) {
+        // A slot is at most (2^32 - 1) * 2^32 and the carry below 2^32, so no overflow
+        uint64_t v = acc->slots[i] + carry;
+        acc->slots[i] = (uint32_t)v;
+        carry = v >> 32;
+    }
+    while (carry) {
+        size_t i = acc->len;
+        if (!acc_reserve(acc, i + 1)) return false;
+        acc->slots[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    acc->headroom = UINT32_MAX;
+    return true;
+}
+
+// Makes room for `adds` more additions per slot.
+static bool acc_room(BiAcc *acc, uint64_t adds)
+{
+    if (adds > acc->headroom && !acc_normalize(acc)) return false;
+    acc->headroom -= adds;
+    return true;
+}
+
+bool bi_acc_init(BiAcc *acc, size_t limbs)
+{
+    memset(acc, 0, sizeof *acc);
+    acc->headroom = UINT32_MAX;
+    return limbs == 0 || acc_reserve(acc, limbs);
+}
+
+void bi_acc_free(BiAcc *acc)
+{
+    bi_mem_free(acc->slots);
+    memset(acc, 0, sizeof *acc);
+}
+
+void bi_acc_clear(BiAcc *acc)
+{
+    if (acc->slots) memset(acc->slots, 0, acc->len * sizeof *acc->slots);
+    acc->headroom = UINT32_MAX;
+}
+
+bool bi_acc_add(BiAcc *acc, const BigInt *a)
+{
+    if (!acc_reserve(acc, a->len) || !acc_room(acc, 1)) return false;
+    for (size_t i = 0; i < a->len; ++i) acc->slots[i] += a->limbs[i];
+    return true;
+}
+
+bool bi_acc_muladd(BiAcc *acc, const BigInt *a, const BigInt *b)
+{
+    size_t an = a->len, bn = b->len;
+    if ((an < bn ? an : bn) >= bi_tuning.karatsuba_limbs) {
+        // Karatsuba beats the quadratic loop below; only the sum is deferred
+        BigInt *p = NULL;
+        bi_mul(a, b, &p);
+        bool ok = p && bi_acc_add(acc, p);
+        bi_free(p);
+        return ok;
+    }
+    if (!acc_reserve(acc, an + bn + 1) || !acc_room(acc, 3)) return false;
+    stats_add(ST_MULADD, (uint64_t)an * bn);
+
+    // Column by column: the products of one column are summed in registers
+    // (64 bits plus an overflow count) and land in three slots.
+    const uint32_t *x = a->limbs, *y = b->limbs;
+    uint64_t *s = acc->slots;
+    for (size_t k = 0; k < an + bn - 1; ++k) {
+        size_t lo = (k >= bn) ? k - bn + 1 : 0;
+        size_t hi = (k < an) ? k : an - 1;
+        uint64_t sum = 0;
+        uint32_t over = 0;
+        for (size_t i = lo; i <= hi; ++i) {
+            uint64_t prod = (uint64_t)x[i] * y[k - i];
+            sum  += prod;
+            over += (sum < prod);
+        }
+        s[k]     += (uint32_t)sum;
+        s[k + 1] += sum >> 32;
+        s[k + 2] += over;
+    }
+    return true;
+}
+
+BigInt *bi_acc_result(BiAcc *acc)
+{
+    if (!acc_normalize(acc)) return NULL;
+    BigInt *r = bi_new(acc->len);
+    if (!r) return NULL;
+    for (size_t i = 0; i < acc->len; ++i) r->limbs[i] = (uint32_t)acc->slots[i];
+    bi_trim(r);
+    return r;
+}
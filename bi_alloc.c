@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocator behind every BigInt.
+ *
+ * The default wraps malloc with a 16-byte size header so it can keep
+ * per-thread counts of live bytes, peak bytes and calls without locks.
+ * Each thread's counters are registered once, on its first allocation,
+ * and stay readable after the thread exits so totals remain complete.
+ * Memory freed on another thread than it was allocated on lowers the
+ * freeing thread's live count, which may therefore go negative; the
+ * total over all threads is always exact.
+ */
+
+#define HDR 16   // keeps the payload aligned for any type
+
+typedef struct AllocNode {
+    BiAllocStats      st;
+    struct AllocNode *next;
+} AllocNode;
+
+static __thread AllocNode *alloc_tls = NULL;
+static AllocNode          *alloc_all = NULL;
+static pthread_mutex_t     alloc_mu  = PTHREAD_MUTEX_INITIALIZER;
+
+static BiAllocStats *register_thread(void)
+{
+    AllocNode *n = calloc(1, sizeof *n);
+    if (!n) return NULL;
+    pthread_mutex_lock(&alloc_mu);
+    n->next = alloc_all;
+    alloc_all = n;
+    pthread_mutex_unlock(&alloc_mu);
+    alloc_tls = n;
+    return &n->st;
+}
+
+// Runs on every BigInt allocation, so keep the common path to a TLS load
+// and a few adds.
+static inline void account(int64_t delta, bool alloc, bool freed)
+{
+    BiAllocStats *st = alloc_tls ? &alloc_tls->st : register_thread();
+    if (!st) return;
+    st->live_bytes += delta;
+    if (st->live_bytes > st->peak_bytes) st->peak_bytes = st->live_bytes;
+    st->allocs += alloc;
+    st->frees  += freed;
+}
+
+static void *default_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    unsigned char *p = malloc(HDR + size);
+    if (!p) return NULL;
+    memcpy(p, &size, sizeof size);
+    account((int64_t)size, true, false);
+    return p + HDR;
+}
+
+static void *default_realloc(void *ctx, void *ptr, size_t size)
+{
+    if (!ptr) return default_alloc(ctx, size);
+    unsigned char *p = (unsigned char *)ptr - HDR;
+    size_t old;
+    memcpy(&old, p, sizeof old);
+    p = realloc(p, HDR + size);
+    if (!p) return NULL;
+    memcpy(p, &size, sizeof size);
+    account((int64_t)size - (int64_t)old, size > old, false);
+    return p + HDR;
+}
+
+static void default_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+    if (!ptr) return;
+    unsigned char *p = (unsigned char *)ptr - HDR;
+    size_t size;
+    memcpy(&size, p, sizeof size);
+    account(-(int64_t)size, false, true);
+    free(p);
+}
+
+static const BiAllocator default_allocator = { default_alloc, default_realloc, default_free, NULL };
+static BiAllocator current = { default_alloc, default_realloc, default_free, NULL };
+
+void bi_set_allocator(const BiAllocator *a)
+{
+    current = (a && a->alloc && a->realloc && a->free) ? *a : default_allocator;
+}
+
+const BiAllocator *bi_get_allocator(void)
+{
+    return &current;
+}
+
+// Direct calls while the default is installed let the compiler inline it.
+void *bi_mem_alloc(size_t size)
+{
+    if (current.alloc == default_alloc) return default_alloc(NULL, size);
+    return current.alloc(current.ctx, size);
+}
+
+void *bi_mem_realloc(void *p, size_t size)
+{
+    if (current.realloc == default_realloc) return default_realloc(NULL, p, size);
+    return current.realloc(current.ctx, p, size);
+}
+
+void bi_mem_free(void *p)
+{
+    if (current.free == default_free) default_free(NULL, p);
+    else current.free(current.ctx, p);
+}
+
+void bi_alloc_thread_stats(BiAllocStats *out)
+{
+    BiAllocStats zero = { 0, 0, 0, 0 };
+    *out = alloc_tls ? alloc_tls->st : zero;
+}
+
+void bi_alloc_total_stats(BiAllocStats *out)
+{
+    BiAllocStats sum = { 0, 0, 0, 0 };
+    pthread_mutex_lock(&alloc_mu);
+    for (AllocNode *n = alloc_all; n; n = n->next) {
+        sum.live_bytes += n->st.live_bytes;
+        if (n->st.peak_bytes > sum.peak_bytes) sum.peak_bytes = n->st.peak_bytes;
+        sum.allocs += n->st.allocs;
+        sum.frees  += n->st.frees;
+    }
+    pthread_mutex_unlock(&alloc_mu);
+    *out = sum;
+}
@@ -0,0 +1,388 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include "bench_util.h"
+#include "pool.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Arithmetic self-checks run by `make test`. The stock key is far too
+ * small to reach the large-operand and threaded paths, so these run them
+ * on random operands of the sizes that select them and compare with the
+ * plain algorithms.
+ *
+ *   pexp   bi_modexp_par against bi_modexp for exponents of 256 bits and
+ *          more on 2 to 4 threads, then again with allocations failing
+ *          part-way: the result must be NULL or correct, nothing may
+ *          leak, and no thread may be left waiting.
+ *   divmod bi_divmod with bi_tuning.bz_limbs and newton_limbs lowered so
+ *          small divisors take Burnikel-Ziegler and Newton + Barrett,
+ *          against algorithm D (both knobs at SIZE_MAX) on the same
+ *          operands, and q * m + r == a with r < m for every result.
+ *   mul    bi_mul with karatsuba_limbs, ntt_limbs and par_mul_limbs
+ *          lowered, on a serial and a 4-thread shared pool, against the
+ *          schoolbook product: Karatsuba, its pool split, the NTT with
+ *          Garner recombination and split transforms, for balanced,
+ *          unbalanced and squared (a == b) operands.
+ *
+ * Usage: rsa_check   (one line per check; exit status 1 on any failure)
+ */
+
+#define PEXP_THREADS 4
+
+static size_t failures = 0;
+
+static bool expect(bool ok, const char *what, size_t bits)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL %s (%zu bits)\n", what, bits);
+        failures++;
+    }
+    return ok;
+}
+
+static bool same(const BigInt *a, const BigInt *b)
+{
+    return a && b && bi_cmp(a, b) == 0;
+}
+
+static int64_t live_bytes(void)
+{
+    BiAllocStats st;
+    bi_alloc_total_stats(&st);
+    return st.live_bytes;
+}
+
+// Allocator that fails once `alloc_budget` allocations have been made.
+static BiAllocator real_alloc;
+static long        alloc_budget;    // (atomic)
+
+static bool budget_take(void)
+{
+    return __atomic_sub_fetch(&alloc_budget, 1, __ATOMIC_SEQ_CST) >= 0;
+}
+
+static void *failing_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return budget_take() ? real_alloc.alloc(real_alloc.ctx, size) : NULL;
+}
+
+static void *failing_realloc(void *ctx, void *p, size_t size)
+{
+    (void)ctx;
+    return budget_take() ? real_alloc.realloc(real_alloc.ctx, p, size) : NULL;
+}
+
+static void failing_free(void *ctx, void *p)
+{
+    (void)ctx;
+    real_alloc.free(real_alloc.ctx, p);
+}
+
+// The library reports every failed allocation on stderr; the injected
+// ones are expected, so their messages are dropped.
+static int quiet_begin(void)
+{
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) { dup2(null, STDERR_FILENO); close(null); }
+    return saved;
+}
+
+static void quiet_end(int saved)
+{
+    fflush(stderr);
+    if (saved >= 0) { dup2(saved, STDERR_FILENO); close(saved); }
+}
+
+
+static void check_pexp_case(const BigInt *b, const BigInt *e, const BigInt *m, size_t bits)
+{
+    BigInt *want = NULL;
+    bi_modexp(b, e, m, &want);
+    for (size_t t = 2; t <= PEXP_THREADS; ++t) {
+        BigInt *got = NULL;
+        bi_modexp_par(b, e, m, t, &got);
+        expect(same(got, want), "bi_modexp_par", bits);
+        bi_free(got);
+    }
+    bi_free(want);
+}
+
+static void check_pexp(void)
+{
+    static const size_t sizes[][2] = {    // modulus bits, exponent bits
+        { 256, 256 }, { 512, 300 }, { 512, 1000 }, { 1024, 1024 }, { 2048, 2048 },
+    };
+    size_t cases = 0;
+    pool_shared_set_threads(PEXP_THREADS);
+
+    for (size_t i = 0; i < sizeof sizes / sizeof *sizes; ++i) {
+        for (int trial = 0; trial < 2; ++trial) {
+            BigInt *m = bench_random_bits(sizes[i][0], true);
+            BigInt *e = bench_random_bits(sizes[i][1], false);
+            BigInt *b = bench_random_bits(sizes[i][0] + 40, false);   // wider than m
+            check_pexp_case(b, e, m, sizes[i][1]);
+            bi_free(m); bi_free(e); bi_free(b);
+            cases++;
+        }
+    }
+
+    // One set bit leaves all but one part empty; all bits set gives every
+    // part the most work.
+    BigInt *m = bench_random_bits(512, true);
+    BigInt *b = bench_random_bits(500, false);
+    BigInt *e = bi_new(10);
+    if (!m || !b || !e) { fprintf(stderr, "Error: out of memory.\n"); exit(1); }
+    e->limbs[9] = 0x80000000u;
+    check_pexp_case(b, e, m, 320);
+    for (size_t k = 0; k < 10; ++k) e->limbs[k] = 0xFFFFFFFFu;
+    check_pexp_case(b, e, m, 320);
+    cases += 2;
+
+    // Fail the k-th allocation for growing k until a run gets through.
+    real_alloc = *bi_get_allocator();
+    BiAllocator failing = { failing_alloc, failing_realloc, failing_free, NULL };
+    BigInt *want = NULL;
+    bi_modexp(b, e, m, &want);
+    int64_t live = live_bytes();
+    size_t failed_runs = 0;
+    for (long k = 0; ; k += 3) {
+        BigInt *got = NULL;
+        __atomic_store_n(&alloc_budget, k, __ATOMIC_SEQ_CST);
+        int saved = quiet_begin();
+        bi_set_allocator(&failing);
+        bi_modexp_par(b, e, m, PEXP_THREADS, &got);
+        bi_set_allocator(&real_alloc);
+        quiet_end(saved);
+        bool hit = __atomic_load_n(&alloc_budget, __ATOMIC_SEQ_CST) < 0;
+        if (got) expect(same(got, want), "bi_modexp_par under failing allocations", 320);
+        else     expect(hit, "bi_modexp_par failed without an allocation failure", 320);
+        bi_free(got);
+        expect(live_bytes() == live, "bi_modexp_par leaks after an allocation failure", 320);
+        if (!hit) break;
+        failed_runs++;
+    }
+    bi_free(want);
+    bi_free(m); bi_free(b); bi_free(e);
+
+    pool_shared_set_threads(1);
+    printf("pexp     %zu cases on 2-%d threads, %zu runs with a failed allocation\n",
+           cases, PEXP_THREADS, failed_runs);
+}
+
+
+static BigInt *all_ones(size_t limbs)
+{
+    BigInt *x = bi_new(limbs);
+    if (!x) { fprintf(stderr, "Error: out of memory.\n"); exit(1); }
+    for (size_t i = 0; i < limbs; ++i) x->limbs[i] = 0xFFFFFFFFu;
+    return x;
+}
+
+// 1 to 32 * limbs bits, so sizes straddle every limb boundary.
+static size_t random_size(size_t limbs)
+{
+    return 1 + (size_t)(bench_rng_next() % (32 * limbs));
+}
+
+// Divisor and dividend for pair i: mostly random sizes, with the shapes
+// that stress quotient estimation mixed in.
+static void div_operands(size_t i, BigInt **a, BigInt **m)
+{
+    size_t mb = random_size(96);
+    BigInt *q = NULL;
+    switch (i % 6) {
+    case 0:                         // random
+        *m = bench_random_bits(mb, false);
+        *a = bench_random_bits(mb + random_size(3 * (mb / 32) + 2), false);
+        break;
+    case 1:                         // exact multiple: r == 0
+        *m = bench_random_bits(mb, false);
+        q  = bench_random_bits(random_size(3 * (mb / 32) + 2), false);
+        bi_mul(*m, q, a);
+        bi_free(q);
+        break;
+    case 2:                         // B^k - 1 by B^j - 1: every quotient digit saturates
+        *m = all_ones(1 + mb / 32);
+        *a = all_ones((1 + mb / 32) * 2 + (size_t)(bench_rng_next() % 40));
+        break;
+    case 3:                         // top limb 1: largest normalizing shift
+        *m = bench_random_bits(mb - mb % 32 + 1, false);
+        *a = bench_random_bits(mb * 3, false);
+        break;
+    case 4:                         // a < m
+        *m = bench_random_bits(mb + 1, false);
+        *a = bench_random_bits(random_size(mb / 32 + 1) % mb + 1, false);
+        break;
+    default: {                      // divisor with zero limbs on top
+        BigInt *t = bench_random_bits(mb, false);
+        *m = bi_new(t->len + 2);
+        if (!*m) { fprintf(stderr, "Error: out of memory.\n"); exit(1); }
+        for (size_t k = 0; k < t->len; ++k) (*m)->limbs[k] = t->limbs[k];
+        *a = bench_random_bits(mb * 2 + 7, false);
+        bi_free(t);
+        break;
+    }
+    }
+    if (!*a) { fprintf(stderr, "Error: out of memory.\n"); exit(1); }
+}
+
+// q * m + r == a and r < m.
+static bool div_identity(const BigInt *a, const BigInt *m, const BigInt *q, const BigInt *r)
+{
+    if (!q || !r || bi_cmp(r, m) >= 0) return false;
+    BigInt *qm = NULL, *sum = NULL;
+    bi_mul(q, m, &qm);
+    if (qm) bi_add(qm, r, &sum);
+    bool ok = sum && bi_cmp(sum, a) == 0;
+    bi_free(qm); bi_free(sum);
+    return ok;
+}
+
+#define DIV_PAIRS 600
+
+static void check_divmod(void)
+{
+    static const size_t knobs[][2] = {    // bz_limbs, newton_limbs
+        { 2, SIZE_MAX }, { 3, SIZE_MAX }, { 5, SIZE_MAX }, { 8, SIZE_MAX },
+        { 2, 4 }, { 4, 4 }, { 6, 12 }, { 16, 24 },
+    };
+    const size_t nknobs = sizeof knobs / sizeof *knobs;
+    BiTuning saved = bi_tuning;
+
+    for (size_t i = 0; i < DIV_PAIRS; ++i) {
+        BigInt *a, *m;
+        div_operands(i, &a, &m);
+        BigInt tm = *m;                 // trimmed view, for the identity check
+        while (tm.len > 1 && tm.limbs[tm.len - 1] == 0) tm.len--;
+        size_t bits = bi_bitlen(m);
+
+        BigInt *q0 = NULL, *r0 = NULL;
+        bi_tuning.bz_limbs = bi_tuning.newton_limbs = SIZE_MAX;
+        bi_divmod(a, m, &q0, &r0);
+        expect(div_identity(a, &tm, q0, r0), "bi_divmod (algorithm D)", bits);
+
+        for (size_t k = 0; k < nknobs; ++k) {
+            BigInt *q = NULL, *r = NULL;
+            bi_tuning.bz_limbs     = knobs[k][0];
+            bi_tuning.newton_limbs = knobs[k][1];
+            bi_divmod(a, m, &q, &r);
+            bool ok = expect(same(q, q0) && same(r, r0), "bi_divmod against algorithm D", bits);
+            if (ok) expect(div_identity(a, &tm, q, r), "bi_divmod q * m + r == a", bits);
+            bi_free(q); bi_free(r);
+        }
+        bi_free(q0); bi_free(r0);
+        bi_free(a); bi_free(m);
+    }
+    bi_tuning = saved;
+    printf("divmod   %d pairs under %zu threshold settings\n", DIV_PAIRS, nknobs);
+}
+
+
+// Operands for product i; *b == *a for squarings. The last MUL_BIG pairs
+// are long enough for bi_ntt_mul to split its transforms over the pool.
+#define MUL_PAIRS 300
+#define MUL_BIG   2
+
+static void mul_operands(size_t i, BigInt **a, BigInt **b)
+{
+    size_t an = random_size(160), bn = random_size(160);
+    *b = NULL;
+    if (i == MUL_PAIRS) {
+        *a = bench_random_bits(5000 * 32, false);
+        *b = bench_random_bits(5000 * 32 - 7, false);
+        return;
+    }
+    if (i == MUL_PAIRS + 1) {
+        *a = bench_random_bits(9000 * 32, false);
+        *b = bench_random_bits(3100 * 32, false);
+        return;
+    }
+    switch (i % 5) {
+    case 0:                         // balanced
+        *a = bench_random_bits(an, false);
+        *b = bench_random_bits(an + bench_rng_next() % 32, false);
+        break;
+    case 1:                         // squaring
+        *a = bench_random_bits(an, false);
+        break;
+    case 2:                         // unbalanced, up to 12 : 1
+        *a = bench_random_bits(bn * (2 + bench_rng_next() % 11), false);
+        *b = bench_random_bits(bn, false);
+        break;
+    case 3:                         // all ones: longest carry chains
+        *a = all_ones(1 + an / 32);
+        *b = all_ones(1 + bn / 32);
+        break;
+    default:                        // random sizes, either order
+        *a = bench_random_bits(an, false);
+        *b = bench_random_bits(bn * 2, false);
+        break;
+    }
+}
+
+static void set_mul_knobs(size_t kara, size_t ntt, size_t par)
+{
+    bi_tuning.karatsuba_limbs = kara;
+    bi_tuning.ntt_limbs       = ntt;
+    bi_tuning.par_mul_limbs   = par;
+}
+
+static void check_mul(void)
+{
+    static const size_t knobs[][3] = {    // karatsuba_limbs, ntt_limbs, par_mul_limbs
+        { 4, SIZE_MAX, SIZE_MAX }, { 4, SIZE_MAX, 8 }, { 4, 4, SIZE_MAX },
+        { 6, 16, 16 }, { 12, 40, 4 },
+    };
+    static const size_t pools[] = { 1, PEXP_THREADS };
+    const size_t nknobs = sizeof knobs / sizeof *knobs;
+    BiTuning saved = bi_tuning;
+
+    for (size_t i = 0; i < MUL_PAIRS + MUL_BIG; ++i) {
+        BigInt *a, *b;
+        mul_operands(i, &a, &b);
+        const BigInt *y = b ? b : a;
+        size_t bits = bi_bitlen(a);
+
+        BigInt *want = NULL;
+        pool_shared_set_threads(1);
+        set_mul_knobs(SIZE_MAX, SIZE_MAX, SIZE_MAX);
+        bi_mul(a, y, &want);
+
+        for (size_t p = 0; p < sizeof pools / sizeof *pools; ++p) {
+            pool_shared_set_threads(pools[p]);
+            for (size_t k = 0; k < nknobs; ++k) {
+                BigInt *got = NULL;
+                set_mul_knobs(knobs[k][0], knobs[k][1], knobs[k][2]);
+                bi_mul(a, y, &got);
+                expect(same(got, want), pools[p] > 1 ? "bi_mul on the shared pool" : "bi_mul", bits);
+                bi_free(got);
+            }
+        }
+        bi_free(want);
+        bi_free(a); bi_free(b);
+    }
+    pool_shared_set_threads(1);
+    bi_tuning = saved;
+    printf("mul      %d products under %zu threshold settings on 1 and %d threads\n",
+           MUL_PAIRS + MUL_BIG, nknobs, PEXP_THREADS);
+}
+
+
+int main(void)
+{
+    check_pexp();
+    check_divmod();
+    check_mul();
+    if (failures) {
+        fprintf(stderr, "%zu check(s) failed.\n", failures);
+        return 1;
+    }
+    printf("All arithmetic checks passed.\n");
+    return 0;
+}
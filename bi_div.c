@@ -0,0 +1,454 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Division.
+ *
+ * bi_divmod picks one of three methods by divisor size (limbs, B = 2^32):
+ *   below bi_tuning.bz_limbs      Knuth's algorithm D, O(n * m) words;
+ *   below bi_tuning.newton_limbs  Burnikel-Ziegler: the dividend is cut
+ *                                 into n-limb digits and each 2n/n step
+ *                                 recurses into two 3n/2n half-size steps,
+ *                                 so the work is done by bi_mul (Karatsuba);
+ *   above                         Barrett steps against floor(B^2n / m),
+ *                                 computed once per call by Newton iteration.
+ * The last two work on a normalized divisor (top bit set) and undo the
+ * shift on the remainder.
+ */
+
+/* Knuth's algorithm D (TAOCP 4.3.1) on raw limbs: q[0..un-vn] = u / v and
+ * r[0..vn) = u % v, for un >= vn >= 1 and v[vn-1] != 0. Either output may
+ * be NULL. One pass per quotient limb, so O(un * vn) word operations.
+ */
+static bool limbs_divmod(const uint32_t *u, size_t un, const uint32_t *v, size_t vn,
+                         uint32_t *q, uint32_t *r)
+{
+    if (vn == 1) {
+        uint64_t rem = 0;
+        for (size_t i = un; i-- > 0;) {
+            uint64_t cur = (rem << 32) | u[i];
+            if (q) q[i] = (uint32_t)(cur / v[0]);
+            rem = cur % v[0];
+        }
+        if (r) r[0] = (uint32_t)rem;
+        return true;
+    }
+
+    uint32_t *nu = bi_mem_alloc((un + 1 + vn) * sizeof *nu);
+    if (!nu) return false;
+    uint32_t *nv = nu + un + 1;
+
+    // Normalize so the divisor's top bit is set; qhat is then off by at most 2
+    unsigned s = (unsigned)__builtin_clz(v[vn - 1]);
+    for (size_t i = vn - 1; i > 0; --i)
+        nv[i] = (uint32_t)(((uint64_t)v[i] << s) | ((uint64_t)v[i - 1] >> (32 - s)));
+    nv[0] = v[0] << s;
+    nu[un] = (uint32_t)((uint64_t)u[un - 1] >> (32 - s));
+    for (size_t i = un - 1; i > 0; --i)
+        nu[i] = (uint32_t)(((uint64_t)u[i] << s) | ((uint64_t)u[i - 1] >> (32 - s)));
+    nu[0] = u[0] << s;
+
+    const uint64_t B = 1ULL << 32;
+    for (size_t j = un - vn + 1; j-- > 0;) {
+        uint64_t num  = ((uint64_t)nu[j + vn] << 32) | nu[j + vn - 1];
+        uint64_t qhat = num / nv[vn - 1];
+        uint64_t rhat = num % nv[vn - 1];
+        while (qhat >= B || qhat * nv[vn - 2] > ((rhat << 32) | nu[j + vn - 2])) {
+            qhat--;
+            rhat += nv[vn - 1];
+            if (rhat >= B) break;
+        }
+
+        // nu[j..j+vn] -= qhat * nv
+        int64_t t;
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < vn; ++i) {
+            uint64_t p = qhat * nv[i];
+            t = (int64_t)nu[i + j] - (int64_t)borrow - (int64_t)(p & 0xFFFFFFFFu);
+            nu[i + j] = (uint32_t)t;
+            borrow = (p >> 32) - (uint64_t)(t >> 32);
+        }
+        t = (int64_t)nu[j + vn] - (int64_t)borrow;
+        nu[j + vn] = (uint32_t)t;
+
+        if (t < 0) {
+            // qhat was one too large: add the divisor back
+            qhat--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < vn; ++i) {
+                uint64_t sum = (uint64_t)nu[i + j] + nv[i] + carry;
+                nu[i + j] = (uint32_t)sum;
+                carry = sum >> 32;
+            }
+            nu[j + vn] += (uint32_t)carry;
+        }
+        if (q) q[j] = (uint32_t)qhat;
+    }
+
+    if (r) {
+        for (size_t i = 0; i < vn; ++i)
+            r[i] = (uint32_t)(((uint64_t)nu[i] >> s) | ((uint64_t)nu[i + 1] << (32 - s)));
+    }
+    bi_mem_free(nu);
+    return true;
+}
+
+// q = a / d and r = a % d by algorithm D; d must be nonzero and trimmed.
+static bool knuth_divmod(const BigInt *a, const BigInt *d, BigInt **q, BigInt **r)
+{
+    size_t an = a->len;
+    while (an > 1 && a->limbs[an - 1] == 0) an--;
+    *q = *r = NULL;
+    if (an < d->len) {
+        *q = bi_from_u64(0);
+        *r = bi_copy(a);
+    } else {
+        *q = bi_new(an - d->len + 1);
+        *r = bi_new(d->len);
+        stats_add(ST_DIVMOD_ITERS, an - d->len + 1);
+        if (*q && *r && !limbs_divmod(a->limbs, an, d->limbs, d->len, (*q)->limbs, (*r)->limbs)) {
+            bi_free(*q); bi_free(*r);
+            *q = *r = NULL;
+        }
+    }
+    if (!*q || !*r) {
+        bi_free(*q); bi_free(*r);
+        *q = *r = NULL;
+        return false;
+    }
+    bi_trim(*q);
+    bi_trim(*r);
+    return true;
+}
+
+// Limb-granular pieces: x * B^k, floor(x / B^k), x mod B^k, hi * B^k + lo.
+static BigInt *shl_limbs(const BigInt *x, size_t k)
+{
+    BigInt *r = bi_new(x->len + k);
+    if (!r) return NULL;
+    memcpy(r->limbs + k, x->limbs, x->len * sizeof *r->limbs);
+    bi_trim(r);
+    return r;
+}
+
+static BigInt *shr_limbs(const BigInt *x, size_t k)
+{
+    if (k >= x->len) return bi_from_u64(0);
+    BigInt *r = bi_new(x->len - k);
+    if (!r) return NULL;
+    memcpy(r->limbs, x->limbs + k, r->len * sizeof *r->limbs);
+    bi_trim(r);
+    return r;
+}
+
+static BigInt *low_limbs(const BigInt *x, size_t k)
+{
+    BigInt *r = bi_new(k < x->len ? k : x->len);
+    if (!r) return NULL;
+    memcpy(r->limbs, x->limbs, r->len * sizeof *r->limbs);
+    bi_trim(r);
+    return r;
+}
+
+static BigInt *join_limbs(const BigInt *hi, const BigInt *lo, size_t k)
+{
+    assert(lo->len <= k || (lo->len == 1 && lo->limbs[0] == 0));
+    BigInt *r = bi_new(hi->len + k);
+    if (!r) return NULL;
+    memcpy(r->limbs, lo->limbs, (lo->len < k ? lo->len : k) * sizeof *r->limbs);
+    memcpy(r->limbs + k, hi->limbs, hi->len * sizeof *r->limbs);
+    bi_trim(r);
+    return r;
+}
+
+// x << s or x >> s for 0 <= s < 32.
+static BigInt *shift_bits(const BigInt *x, unsigned s, bool left)
+{
+    BigInt *r = bi_new(x->len + left);
+    if (!r) return NULL;
+    if (s == 0) {
+        memcpy(r->limbs, x->limbs, x->len * sizeof *r->limbs);
+    } else if (left) {
+        uint32_t carry = 0;
+        for (size_t i = 0; i < x->len; ++i) {
+            r->limbs[i] = (x->limbs[i] << s) | carry;
+            carry = x->limbs[i] >> (32 - s);
+        }
+        r->limbs[x->len] = carry;
+    } else {
+        for (size_t i = 0; i < x->len; ++i) {
+            uint32_t next = (i + 1 < x->len) ? x->limbs[i + 1] : 0;
+            r->limbs[i] = (x->limbs[i] >> s) | (next << (32 - s));
+        }
+    }
+    bi_trim(r);
+    return r;
+}
+
+// Replaces *x with *x + y (add) or *x - y; false on allocation failure.
+static bool update(BigInt **x, const BigInt *y, bool add)
+{
+    BigInt *t = NULL;
+    if (add) bi_add(*x, y, &t); else bi_sub(*x, y, &t);
+    if (!t) return false;
+    bi_free(*x);
+    *x = t;
+    return true;
+}
+
+static bool bz_div2n1n(const BigInt *a, const BigInt *b, size_t n, BigInt **q, BigInt **r);
+static bool divmod_large(const BigInt *a, const BigInt *m, size_t n, BigInt **q_out, BigInt **r_out);
+
+/* [a12, a3] / [b1, b2] where every letter is n limbs: estimate the quotient
+ * from the top 2n/n limbs, then correct it (at most twice, b is normalized).
+ */
+static bool bz_div3n2n(const BigInt *a12, const BigInt *a3, const BigInt *b,
+                       const BigInt *b1, const BigInt *b2, size_t n, BigInt **q_out, BigInt **r_out)
+{
+    BigInt *q = NULL, *r = NULL, *top = NULL, *t = NULL;
+    bool ok = false;
+
+    if (!(top = shr_limbs(a12, n))) goto done;
+    if (bi_cmp(top, b1) == 0) {
+        // The estimate would be B^n: use B^n - 1 and r = a12 - b1 * B^n + b1
+        if (!(q = bi_new(n))) goto done;
+        memset(q->limbs, 0xFF, n * sizeof *q->limbs);
+        if (!(t = shl_limbs(b1, n)) || !(r = bi_copy(a12))) goto done;
+        bi_trim(r);
+        if (!update(&r, b1, true) || !update(&r, t, false)) goto done;
+        bi_free(t); t = NULL;
+    } else if (!bz_div2n1n(a12, b1, n, &q, &r)) {
+        goto done;
+    }
+
+    BigInt *rr = join_limbs(r, a3, n);
+    bi_free(r);
+    r = rr;
+    if (!r) goto done;
+    bi_mul(q, b2, &t);
+    if (!t) goto done;
+    while (bi_cmp(r, t) < 0) {
+        bi_sub_u32(q, 1);
+        if (!update(&r, b, true)) goto done;
+    }
+    ok = update(&r, t, false);
+
+done:
+    bi_free(top); bi_free(t);
+    if (!ok) { bi_free(q); bi_free(r); q = r = NULL; }
+    *q_out = q;
+    *r_out = r;
+    return ok;
+}
+
+// a / b for normalized b of n limbs and a < b * B^n, so q has at most n limbs.
+static bool bz_div2n1n(const BigInt *a, const BigInt *b, size_t n, BigInt **q, BigInt **r)
+{
+    if (n < bi_tuning.bz_limbs || n < 2) return knuth_divmod(a, b, q, r);
+
+    BigInt *ap = NULL, *bp = NULL, *b1 = NULL, *b2 = NULL, *a1 = NULL, *a2 = NULL, *a3 = NULL;
+    BigInt *mid = NULL, *q1 = NULL, *q2 = NULL, *r1 = NULL, *r2 = NULL;
+    bool ok = false;
+    bool pad = n & 1;
+
+    *q = *r = NULL;
+    if (pad) {
+        // Scale both by B so n is even; only the remainder needs undoing
+        if (!(ap = shl_limbs(a, 1)) || !(bp = shl_limbs(b, 1))) goto done;
+        a = ap; b = bp; n++;
+    }
+    size_t h = n / 2;
+    if (!(b1 = shr_limbs(b, h)) || !(b2 = low_limbs(b, h))) goto done;
+    if (!(a1 = shr_limbs(a, n)) || !(mid = shr_limbs(a, h)) ||
+        !(a2 = low_limbs(mid, h)) || !(a3 = low_limbs(a, h))) goto done;
+
+    if (!bz_div3n2n(a1, a2, b, b1, b2, h, &q1, &r1)) goto done;
+    if (!bz_div3n2n(r1, a3, b, b1, b2, h, &q2, &r2)) goto done;
+    if (!(*q = join_limbs(q1, q2, h))) goto done;
+    if (pad) {
+        if (!(*r = shr_limbs(r2, 1))) goto done;
+    } else {
+        *r = r2; r2 = NULL;
+    }
+    ok = true;
+
+done:
+    bi_free(ap); bi_free(bp); bi_free(b1); bi_free(b2);
+    bi_free(a1); bi_free(a2); bi_free(a3); bi_free(mid);
+    bi_free(q1); bi_free(q2); bi_free(r1); bi_free(r2);
+    if (!ok) { bi_free(*q); bi_free(*r); *q = *r = NULL; }
+    return ok;
+}
+
+// B^k as a BigInt.
+static BigInt *limb_power(size_t k)
+{
+    BigInt *p = bi_new(k + 1);
+    if (p) p->limbs[k] = 1;
+    return p;
+}
+
+/* floor(B^2n / b) for normalized b of n limbs. The reciprocal of the top
+ * half, shifted into place, is within a relative B^-n/2 of the answer;
+ * one Newton step x += x * (B^2n - b*x) / B^2n squares that error, and
+ * a final check against b*x fixes the last few units.
+ */
+static BigInt *newton_recip(const BigInt *b, size_t n)
+{
+    BigInt *x = NULL, *pw = NULL, *p = NULL, *e = NULL, *t = NULL, *dx = NULL;
+    BigInt *bh = NULL, *xh = NULL, *rem = NULL;
+    bool ok = false;
+
+    if (!(pw = limb_power(2 * n))) goto done;
+    if (n < bi_tuning.newton_limbs || n < 4) {
+        ok = (n < bi_tuning.bz_limbs) ? knuth_divmod(pw, b, &x, &rem)
+                                      : divmod_large(pw, b, n, &x, &rem);
+        goto done;
+    }
+    size_t h = (n + 1) / 2;
+    if (!(bh = shr_limbs(b, n - h)) || !(xh = newton_recip(bh, h))) goto done;
+    if (!(x = shl_limbs(xh, n - h))) goto done;
+
+    bi_mul(b, x, &p);
+    if (!p) goto done;
+    bool below = bi_cmp(p, pw) <= 0;
+    if (below) bi_sub(pw, p, &e); else bi_sub(p, pw, &e);
+    if (!e) goto done;
+    bi_mul(x, e, &t);
+    if (!t || !(dx = shr_limbs(t, 2 * n))) goto done;
+    if (!below && !update(&x, dx, false)) goto done;
+    if (below && !update(&x, dx, true)) goto done;
+
+    // Now b * x <= B^2n < b * (x + 1)
+    bi_free(p); p = NULL;
+    bi_mul(b, x, &p);
+    if (!p) goto done;
+    while (bi_cmp(p, pw) > 0) {
+        bi_sub_u32(x, 1);
+        if (!update(&p, b, false)) goto done;
+    }
+    for (;;) {
+        BigInt *next = NULL;
+        bi_add(p, b, &next);
+        if (!next) goto done;
+        if (bi_cmp(next, pw) > 0) { bi_free(next); break; }
+        bi_free(p);
+        p = next;
+        if (!bi_add_u32(x, 1)) goto done;
+    }
+    ok = true;
+
+done:
+    bi_free(pw); bi_free(p); bi_free(e); bi_free(t); bi_free(dx);
+    bi_free(bh); bi_free(xh); bi_free(rem);
+    if (!ok) { bi_free(x); x = NULL; }
+    return x;
+}
+
+/* Barrett step (HAC 14.42) for a < b * B^n with v = floor(B^2n / b): the
+ * estimate floor(floor(a / B^(n-1)) * v / B^(n+1)) is at most two short.
+ */
+static bool barrett_div2n1n(const BigInt *a, const BigInt *b, const BigInt *v, size_t n,
+                            BigInt **q_out, BigInt **r_out)
+{
+    BigInt *q1 = NULL, *q2 = NULL, *q = NULL, *t = NULL, *r = NULL;
+    bool ok = false;
+
+    if (!(q1 = shr_limbs(a, n - 1))) goto done;
+    bi_mul(q1, v, &q2);
+    if (!q2 || !(q = shr_limbs(q2, n + 1))) goto done;
+    bi_mul(q, b, &t);
+    if (!t) goto done;
+    bi_sub(a, t, &r);
+    if (!r) goto done;
+    while (bi_cmp(r, b) >= 0) {
+        if (!update(&r, b, false) || !bi_add_u32(q, 1)) goto done;
+    }
+    ok = true;
+
+done:
+    bi_free(q1); bi_free(q2); bi_free(t);
+    if (!ok) { bi_free(q); bi_free(r); q = r = NULL; }
+    *q_out = q;
+    *r_out = r;
+    return ok;
+}
+
+// a / m with m of n >= bi_tuning.bz_limbs limbs, one n-limb digit of a at a time.
+static bool divmod_large(const BigInt *a, const BigInt *m, size_t n, BigInt **q_out, BigInt **r_out)
+{
+    BigInt *b = NULL, *an = NULL, *v = NULL, *q = NULL, *r = NULL;
+    bool ok = false;
+    unsigned s = (unsigned)__builtin_clz(m->limbs[n - 1]);
+
+    if (!(b = shift_bits(m, s, true)) || !(an = shift_bits(a, s, true))) goto done;
+    if (n >= bi_tuning.newton_limbs && !(v = newton_recip(b, n))) goto done;
+    if (!(q = bi_from_u64(0)) || !(r = bi_from_u64(0))) goto done;
+
+    for (size_t i = (an->len + n - 1) / n; i-- > 0;) {
+        BigInt *hi = NULL, *digit = NULL, *cur = NULL, *qd = NULL, *rd = NULL, *nq = NULL;
+        bool step = (hi = shr_limbs(an, i * n)) && (digit = low_limbs(hi, n)) &&
+                    (cur = join_limbs(r, digit, n));
+        if (step) {
+            step = v ? barrett_div2n1n(cur, b, v, n, &qd, &rd)
+                     : bz_div2n1n(cur, b, n, &qd, &rd);
+        }
+        if (step) step = (nq = join_limbs(q, qd, n)) != NULL;
+        bi_free(hi); bi_free(digit); bi_free(cur); bi_free(qd);
+        if (!step) { bi_free(rd); goto done; }
+        bi_free(q); q = nq;
+        bi_free(r); r = rd;
+    }
+    BigInt *rs = shift_bits(r, s, false);
+    bi_free(r);
+    r = rs;
+    ok = r != NULL;
+
+done:
+    bi_free(b); bi_free(an); bi_free(v);
+    if (!ok) { bi_free(q); bi_free(r); q = r = NULL; }
+    *q_out = q;
+    *r_out = r;
+    return ok;
+}
+
+void bi_divmod(const BigInt *a, const BigInt *m, BigInt **q_res, BigInt **r_res)
+{
+    BigInt *q = NULL, *r = NULL;
+    size_t n = m->len;
+    while (n > 1 && m->limbs[n - 1] == 0) n--;
+
+    // Modulus (divisor m) must be > 0
+    if (n == 1 && m->limbs[0] == 0) {
+        fprintf(stderr, "Error: Divisor must be > 0 in bi_divmod.\n");
+        goto divmod_error;
+    }
+    stats_add(ST_DIVMOD_CALLS, 1);
+
+    size_t an = a->len;
+    while (an > 1 && a->limbs[an - 1] == 0) an--;
+    BigInt *mt = NULL;
+    if (n != m->len) {
+        // Work on a trimmed view of the divisor
+        if (!(mt = bi_copy(m))) goto divmod_error;
+        bi_trim(mt);
+        m = mt;
+    }
+    // Short dividends (a < m included) gain nothing from the recursion
+    bool ok = (n < bi_tuning.bz_limbs || an < n + 2) ? knuth_divmod(a, m, &q, &r)
+                                                     : divmod_large(a, m, n, &q, &r);
+    bi_free(mt);
+    if (!ok) goto divmod_error;
+
+    if (q_res) *q_res = q; else bi_free(q);
+    if (r_res) *r_res = r; else bi_free(r);
+    return;
+
+divmod_error:
+    fprintf(stderr, "Error during bi_divmod calculation.\n");
+    if (q_res) *q_res = NULL;
+    if (r_res) *r_res = NULL;
+}
@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bi_ntt.h"
+#include "BigInt.h"
+#include "stats.h"
+#include "pool.h"
+#include <string.h>
+#include <assert.h>
+
+/* Each prime is c * 2^k + 1 with a known primitive root. Arithmetic inside
+ * the transforms is Montgomery form with R = 2^32, so a modular multiply
+ * is two 32x32 products and a shift instead of a 64-bit division.
+ */
+typedef struct {
+    uint32_t p;
+    uint32_t g;         // primitive root
+    uint32_t pneg;      // -p^-1 mod 2^32
+    uint32_t r2;        // 2^64 mod p, to enter Montgomery form
+} NttPrime;
+
+static const uint32_t PRIMES[3] = { 2013265921u, 1811939329u, 469762049u };  // 15, 27, 7 * 2^k + 1
+static const uint32_t ROOTS[3]  = { 31, 13, 3 };
+
+static inline uint32_t mont_mul(uint32_t a, uint32_t b, const NttPrime *m)
+{
+    uint64_t t = (uint64_t)a * b;
+    uint32_t q = (uint32_t)t * m->pneg;
+    uint32_t u = (uint32_t)((t + (uint64_t)q * m->p) >> 32);
+    return (u >= m->p) ? u - m->p : u;
+}
+
+static inline uint32_t mod_add(uint32_t a, uint32_t b, uint32_t p)
+{
+    uint32_t s = a + b;              // both below 2^31, no wrap
+    return (s >= p) ? s - p : s;
+}
+
+static inline uint32_t mod_sub(uint32_t a, uint32_t b, uint32_t p)
+{
+    return (a >= b) ? a - b : a + p - b;
+}
+
+static uint32_t pow_mod(uint64_t b, uint64_t e, uint32_t p)
+{
+    uint64_t r = 1;
+    b %= p;
+    for (; e; e >>= 1) {
+        if (e & 1) r = r * b % p;
+        b = b * b % p;
+    }
+    return (uint32_t)r;
+}
+
+static void prime_init(NttPrime *m, size_t k)
+{
+    m->p = PRIMES[k];
+    m->g = ROOTS[k];
+    uint32_t inv = m->p;                       // Newton: correct to 3, 6, 12, 24, 48 bits
+    for (int i = 0; i < 4; ++i) inv *= 2 - m->p * inv;
+    m->pneg = 0u - inv;
+    uint64_t r1 = ((uint64_t)1 << 32) % m->p;
+    m->r2 = (uint32_t)(r1 * r1 % m->p);
+}
+
+// tw[j] = w^j for j < n/2, in Montgomery form; w is a primitive n-th root (or its inverse).
+static void twiddles(uint32_t *tw, size_t n, bool inverse, const NttPrime *m)
+{
+    uint32_t w = pow_mod(m->g, (m->p - 1) / n, m->p);
+    if (inverse) w = pow_mod(w, m->p - 2, m->p);
+    uint32_t wm = mont_mul(w, m->r2, m);
+    tw[0] = mont_mul(1, m->r2, m);
+    for (size_t j = 1; j < n / 2; ++j) tw[j] = mont_mul(tw[j - 1], wm, m);
+}
+
+/* Butterflies t0..t1 of the stage with half-width len, numbered across the
+ * whole array. Forward stages are decimation in frequency (natural order
+ * in, bit-reversed out); inverse ones decimation in time with inverse
+ * twiddles, which undoes them without a bit-reversal pass.
+ */
+static void butterflies(uint32_t *a, size_t len, size_t step, const uint32_t *tw, bool inverse,
+                        const NttPrime *m, size_t t0, size_t t1)
+{
+    size_t s = (t0 / len) * 2 * len, j = t0 % len;
+    for (size_t t = t0; t < t1; t += len - j, j = 0, s += 2 * len) {
+        size_t end = (t1 - t < len - j) ? j + (t1 - t) : len;
+        uint32_t *x = a + s, *y = x + len;
+        if (inverse) {
+            for (size_t q = j; q < end; ++q) {
+                uint32_t u = x[q], v = mont_mul(y[q], tw[q * step], m);
+                x[q] = mod_add(u, v, m->p);
+                y[q] = mod_sub(u, v, m->p);
+            }
+        } else {
+            for (size_t q = j; q < end; ++q) {
+                uint32_t u = x[q], v = y[q];
+                x[q] = mod_add(u, v, m->p);
+                y[q] = mont_mul(mod_sub(u, v, m->p), tw[q * step], m);
+            }
+        }
+    }
+}
+
+// Length-n transform of a sub-block whose twiddles are every step0-th entry of tw.
+static void ntt_forward(uint32_t *a, size_t n, const uint32_t *tw, size_t step0, const NttPrime *m)
+{
+    for (size_t len = n / 2, step = step0; len >= 1; len >>= 1, step <<= 1)
+        butterflies(a, len, step, tw, false, m, 0, n / 2);
+}
+
+static void ntt_inverse(uint32_t *a, size_t n, const uint32_t *tw, size_t step0, const NttPrime *m)
+{
+    for (size_t len = 1, step = step0 * (n / 2); len < n; len <<= 1, step >>= 1)
+        butterflies(a, len, step, tw, true, m, 0, n / 2);
+}
+
+/* Parallel transform: the log2(split) outer stages are cut into split
+ * ranges of butterflies, after which the split sub-blocks are independent
+ * transforms of their own (before them, for the inverse).
+ */
+typedef struct {
+    uint32_t       *a;
+    size_t          n, split, len, step;
+    const uint32_t *tw;
+    bool            inverse;
+    const NttPrime *m;
+} NttPass;
+
+static void pass_stage(void *ctx, size_t i)
+{
+    NttPass *p = ctx;
+    size_t per = p->n / 2 / p->split;
+    butterflies(p->a, p->len, p->step, p->tw, p->inverse, p->m, i * per, (i + 1) * per);
+}
+
+static void pass_block(void *ctx, size_t i)
+{
+    NttPass *p = ctx;
+    size_t sub = p->n / p->split;
+    if (p->inverse) ntt_inverse(p->a + i * sub, sub, p->tw, p->split, p->m);
+    else            ntt_forward(p->a + i * sub, sub, p->tw, p->split, p->m);
+}
+
+static void ntt_transform(uint32_t *a, size_t n, const uint32_t *tw, bool inverse,
+                          size_t split, const NttPrime *m)
+{
+    if (split < 2) {
+        if (inverse) ntt_inverse(a, n, tw, 1, m);
+        else         ntt_forward(a, n, tw, 1, m);
+        return;
+    }
+    NttPass p = { a, n, split, 0, 0, tw, inverse, m };
+    if (inverse) pool_fork_join(split, pass_block, &p);
+    for (size_t k = 1; k < split; k <<= 1) {
+        // Forward: half-widths n/2, n/4, ...; inverse the same stages in reverse
+        size_t level = inverse ? split / (2 * k) : k;
+        p.len  = n / (2 * level);
+        p.step = level;
+        pool_fork_join(split, pass_stage, &p);
+    }
+    if (!inverse) pool_fork_join(split, pass_block, &p);
+}
+
+static void load(uint32_t *f, size_t n, const uint32_t *x, size_t xn, const NttPrime *m)
+{
+    for (size_t i = 0; i < xn; ++i) f[i] = mont_mul(x[i] % m->p, m->r2, m);
+    memset(f + xn, 0, (n - xn) * sizeof *f);
+}
+
+typedef struct {
+    uint32_t       *res;      // three residue vectors of n, then CRT words
+    size_t          n, len;   // transform length, coefficients in use
+    const uint32_t *a, *b;
+    size_t          an, bn;
+    size_t          split;    // pieces per transform, 1 when serial
+    bool            failed[3];
+} NttJob;
+
+// The cyclic convolution of a and b modulo prime k, left in res + k * n.
+static void ntt_residue(void *ctx, size_t k)
+{
+    NttJob *j = ctx;
+    size_t n = j->n;
+    bool sqr = (j->a == j->b && j->an == j->bn);
+    uint32_t *tw = bi_mem_alloc((n / 2 + (sqr ? 0 : n)) * sizeof *tw);
+    if (!tw) { j->failed[k] = true; return; }
+    uint32_t *fa = j->res + k * n, *fb = tw + n / 2;
+    NttPrime m;
+    prime_init(&m, k);
+
+    twiddles(tw, n, false, &m);
+    load(fa, n, j->a, j->an, &m);
+    ntt_transform(fa, n, tw, false, j->split, &m);
+    if (sqr) {
+        for (size_t i = 0; i < n; ++i) fa[i] = mont_mul(fa[i], fa[i], &m);
+    } else {
+        load(fb, n, j->b, j->bn, &m);
+        ntt_transform(fb, n, tw, false, j->split, &m);
+        for (size_t i = 0; i < n; ++i) fa[i] = mont_mul(fa[i], fb[i], &m);
+    }
+    twiddles(tw, n, true, &m);
+    ntt_transform(fa, n, tw, true, j->split, &m);
+    // Multiplying by a plain n^-1 also leaves Montgomery form
+    uint32_t ninv = pow_mod(n, m.p - 2, m.p);
+    for (size_t i = 0; i < j->len; ++i) fa[i] = mont_mul(fa[i], ninv, &m);
+    bi_mem_free(tw);
+}
+
+/* Garner over coefficients in chunk i: c = r1 + p1 * k2 + p1 * p2 * k3 is
+ * below 2^91 and replaces the residues as three 32-bit words.
+ */
+static void ntt_garner(void *ctx, size_t chunk)
+{
+    NttJob *j = ctx;
+    const uint64_t p1 = PRIMES[0], p2 = PRIMES[1], p3 = PRIMES[2];
+    const uint64_t inv1  = pow_mod(p1, p2 - 2, (uint32_t)p2);                 // p1^-1 mod p2
+    const uint64_t inv12 = pow_mod(p1 * p2 % p3, p3 - 2, (uint32_t)p3);       // (p1 p2)^-1 mod p3
+    const uint64_t p12 = p1 * p2;
+    const uint64_t p12_lo = (uint32_t)p12, p12_hi = p12 >> 32;
+    uint32_t *w0 = j->res, *w1 = w0 + j->n, *w2 = w1 + j->n;
+    size_t per = (j->len + j->split - 1) / j->split;
+    size_t i0 = chunk * per, i1 = (i0 + per < j->len) ? i0 + per : j->len;
+
+    for (size_t i = i0; i < i1; ++i) {
+        uint64_t r1 = w0[i], r2 = w1[i], r3 = w2[i];
+        uint64_t k2 = (r2 + p2 - r1 % p2) % p2 * inv1 % p2;
+        uint64_t v  = r1 + p1 * k2;                                          // < 2^62
+        uint64_t k3 = (r3 + p3 - v % p3) % p3 * inv12 % p3;
+        uint64_t t0 = k3 * p12_lo, t1 = k3 * p12_hi;                         // t1 < 2^60
+        uint64_t lo = t0 + v;
+        uint64_t hi = (t1 >> 32) + (lo < t0);
+        uint64_t s  = lo + (t1 << 32);
+        hi += (s < lo);
+        w0[i] = (uint32_t)s;
+        w1[i] = (uint32_t)(s >> 32);
+        w2[i] = (uint32_t)hi;
+    }
+}
+
+bool bi_ntt_mul(uint32_t *r, const uint32_t *a, size_t an, const uint32_t *b, size_t bn)
+{
+    size_t len = an + bn - 1, n = 2;
+    while (n < len) n <<= 1;
+    assert(an + bn <= BI_NTT_MAX_LIMBS);
+
+    NttJob j = { NULL, n, len, a, b, an, bn, 1, { false, false, false } };
+    // Split each transform so the three primes together give every thread
+    // about a task, keeping sub-blocks large enough to be worth a hand-off.
+    size_t threads = ((an < bn) ? an : bn) >= bi_tuning.par_mul_limbs ? pool_shared_threads() : 1;
+    while (3 * j.split < 2 * threads && n / j.split >= 8192) j.split *= 2;
+
+    j.res = bi_mem_alloc(3 * n * sizeof *j.res);
+    if (!j.res) return false;
+    stats_add(ST_MULADD, (uint64_t)an * bn);
+
+    if (threads > 1) pool_fork_join(3, ntt_residue, &j);
+    else for (size_t k = 0; k < 3; ++k) ntt_residue(&j, k);
+    bool ok = !j.failed[0] && !j.failed[1] && !j.failed[2];
+    if (ok) {
+        pool_fork_join(j.split, ntt_garner, &j);
+
+        // Coefficients overlap by two words; add them up with a 128-bit carry
+        const uint32_t *w0 = j.res, *w1 = w0 + n, *w2 = w1 + n;
+        uint64_t lo = 0, hi = 0;
+        for (size_t i = 0; i < len; ++i) {
+            uint64_t c = w0[i] | (uint64_t)w1[i] << 32;
+            lo += c;
+            hi += w2[i] + (lo < c);
+            r[i] = (uint32_t)lo;
+            lo = (lo >> 32) | (hi << 32);
+            hi >>= 32;
+        }
+        r[len] = (uint32_t)lo;
+        assert((lo >> 32) == 0 && hi == 0 && "NTT product overflowed its limbs");
+    }
+    bi_mem_free(j.res);
+    return ok;
+}
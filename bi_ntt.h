@@ -0,0 +1,19 @@
+#ifndef BI_NTT_H
+#define BI_NTT_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Number-theoretic transform multiplication for bi_mul.
+ *
+ * The product is convolved modulo three primes below 2^31 that each have
+ * 2^26-th roots of unity, then rebuilt by CRT (Garner). Their product
+ * exceeds 2^90, which bounds every convolution coefficient as long as
+ * the transform length stays within 2^26 limbs.
+ */
+#define BI_NTT_MAX_LIMBS ((size_t)1 << 26)   // an + bn must not exceed this
+
+// r[0..an+bn) = a * b; r need not be zeroed. False on allocation failure.
+bool bi_ntt_mul(uint32_t *r, const uint32_t *a, size_t an, const uint32_t *b, size_t bn);
+
+#endif
@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/* One modexp on several cores, for latency rather than throughput.
+ *
+ * Right-to-left binary: base^exp is the product of base^(2^i) over the set
+ * bits i of exp. Task 0 walks the squaring chain and publishes each power
+ * whose bit is set; tasks 1..parts take the set bits in turn (the c-th set
+ * bit goes to part c % parts) and multiply them into their own partial
+ * product, and the partials are multiplied together at the end. The
+ * squarings stay a serial chain, so the latency is about one squaring per
+ * exponent bit, with the multiplies running beside them on other cores.
+ * Total work is higher than bi_modexp's (bits/2 multiplies instead of
+ * about bits/(w+1)), which is why this is only for otherwise idle cores.
+ */
+
+// Shorter exponents finish before the threads would have helped.
+#define PEXP_MIN_BITS 256
+
+typedef struct {
+    const BigInt   *exp;
+    const BigInt   *mod;
+    size_t          bits;
+    size_t          parts;      // multiplying tasks
+    BigInt         *base;       // reduced; taken over by the squaring task
+    BigInt        **pow;        // pow[i] = base^(2^i) for set bits, freed by its part
+    BigInt        **part;       // part[k]: product of the powers part k took
+    size_t          ready;      // pow[0, ready) are published
+    size_t          waiting;
+    bool            failed;
+    pthread_mutex_t mu;
+    pthread_cond_t  more;
+} PexpJob;
+
+#define EXP_BIT(e, i) (((e)->limbs[(i) / 32] >> ((i) % 32)) & 1)
+
+// a * b mod m as a new number; NULL on allocation failure.
+static BigInt *mulmod(const BigInt *a, const BigInt *b, const BigInt *m)
+{
+    BigInt *t = NULL, *r = NULL;
+    bi_mul(a, b, &t);
+    if (t) bi_mod(t, m, &r);
+    bi_free(t);
+    return r;
+}
+
+// Publishes pow[0, ready), or a failure; false once any task has failed.
+static bool publish(PexpJob *job, size_t ready, bool failed)
+{
+    pthread_mutex_lock(&job->mu);
+    if (!failed) job->ready = ready;
+    job->failed |= failed;
+    failed = job->failed;
+    if (job->waiting || failed) pthread_cond_broadcast(&job->more);
+    pthread_mutex_unlock(&job->mu);
+    return !failed;
+}
+
+static void square_chain(PexpJob *job)
+{
+    BigInt *cur = job->base;
+    job->base = NULL;
+    for (size_t i = 0; i < job->bits; ++i) {
+        // The squaring makes a new number, so the current one can be
+        // handed to its part without a copy.
+        BigInt *next = NULL;
+        if (i + 1 < job->bits && !(next = mulmod(cur, cur, job->mod))) {
+            bi_free(cur);
+            publish(job, i, true);
+            return;
+        }
+        if (EXP_BIT(job->exp, i)) job->pow[i] = cur;
+        else                      bi_free(cur);
+        cur = next;
+        if (!publish(job, i + 1, false)) {
+            bi_free(cur);
+            return;
+        }
+    }
+}
+
+static void multiply_part(PexpJob *job, size_t k)
+{
+    BigInt *acc = NULL;
+    for (size_t i = 0, c = 0; i < job->bits; ++i) {
+        if (!EXP_BIT(job->exp, i) || c++ % job->parts != k) continue;
+
+        pthread_mutex_lock(&job->mu);
+        while (job->ready <= i && !job->failed) {
+            job->waiting++;
+            pthread_cond_wait(&job->more, &job->mu);
+            job->waiting--;
+        }
+        bool failed = job->failed;
+        pthread_mutex_unlock(&job->mu);
+        if (failed) break;
+
+        BigInt *p = job->pow[i];
+        job->pow[i] = NULL;
+        if (!acc) {
+            acc = p;
+            continue;
+        }
+        BigInt *t = mulmod(acc, p, job->mod);
+        bi_free(p);
+        bi_free(acc);
+        acc = t;
+        if (!acc) { publish(job, 0, true); break; }
+    }
+    job->part[k] = acc;
+}
+
+static void pexp_task(void *ctx, size_t i)
+{
+    PexpJob *job = ctx;
+    if (i == 0) square_chain(job);
+    else        multiply_part(job, i - 1);
+}
+
+void bi_modexp_par(const BigInt *base, const BigInt *exp, const BigInt *mod, size_t threads, BigInt **res)
+{
+    size_t bits = bi_bitlen(exp);
+    if (threads > pool_shared_threads()) threads = pool_shared_threads();
+    if (threads < 2 || bits < PEXP_MIN_BITS || bi_bitlen(mod) < 2) {
+        bi_modexp(base, exp, mod, res);
+        return;
+    }
+
+    PexpJob job = { exp, mod, bits, threads - 1 };
+    *res = NULL;
+    bi_mod(base, mod, &job.base);
+    job.pow  = calloc(bits, sizeof *job.pow);
+    job.part = calloc(job.parts, sizeof *job.part);
+    if (!job.base || !job.pow || !job.part) goto pexp_done;
+    pthread_mutex_init(&job.mu, NULL);
+    pthread_cond_init(&job.more, NULL);
+
+    // Task 0 is claimed first and never waits, so the parts always progress
+    pool_fork_join(threads, pexp_task, &job);
+
+    if (!job.failed) {
+        BigInt *y = job.part[0];
+        job.part[0] = NULL;
+        for (size_t k = 1; y && k < job.parts; ++k) {
+            if (!job.part[k]) continue;
+            BigInt *t = mulmod(y, job.part[k], mod);
+            bi_free(y);
+            y = t;
+        }
+        *res = y;
+    }
+    pthread_cond_destroy(&job.more);
+    pthread_mutex_destroy(&job.mu);
+
+pexp_done:
+    if (!*res) fprintf(stderr, "Error during bi_modexp_par calculation.\n");
+    for (size_t i = 0; job.pow && i < bits; ++i) bi_free(job.pow[i]);
+    for (size_t k = 0; job.part && k < job.parts; ++k) bi_free(job.part[k]);
+    free(job.pow);
+    free(job.part);
+    bi_free(job.base);
+}
@@ -0,0 +1,88 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include <assert.h>
+
+/* BigInt with one machine word. These work in place in a single pass over
+ * the limbs, without building a BigInt for the word and without the
+ * general routines' temporaries. The only allocation is a bi_mem_realloc
+ * for one extra limb, when bi_add_u32 or bi_mul_u32 carries out of the top.
+ */
+
+// Appends `top` as a new most significant limb.
+static bool grow(BigInt *a, uint32_t top)
+{
+    uint32_t *l = bi_mem_realloc(a->limbs, (a->len + 1) * sizeof *l);
+    if (!l) {
+        fprintf(stderr, "Error: Allocation failed growing a BigInt.\n");
+        return false;
+    }
+    a->limbs = l;
+    a->limbs[a->len++] = top;
+    return true;
+}
+
+bool bi_add_u32(BigInt *a, uint32_t v)
+{
+    uint64_t carry = v;
+    for (size_t i = 0; carry && i < a->len; ++i) {
+        uint64_t s = (uint64_t)a->limbs[i] + carry;
+        a->limbs[i] = (uint32_t)s;
+        carry = s >> 32;
+    }
+    return carry == 0 || grow(a, (uint32_t)carry);
+}
+
+void bi_sub_u32(BigInt *a, uint32_t v)
+{
+    uint32_t borrow = v;
+    for (size_t i = 0; borrow && i < a->len; ++i) {
+        uint32_t x = a->limbs[i];
+        a->limbs[i] = x - borrow;
+        borrow = (x < borrow);
+    }
+    assert(borrow == 0 && "bi_sub_u32 underflow");
+    bi_trim(a);
+}
+
+bool bi_mul_u32(BigInt *a, uint32_t v)
+{
+    uint64_t carry = 0;
+    for (size_t i = 0; i < a->len; ++i) {
+        uint64_t t = (uint64_t)a->limbs[i] * v + carry;
+        a->limbs[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    if (v == 0) bi_trim(a);
+    return carry == 0 || grow(a, (uint32_t)carry);
+}
+
+uint32_t bi_divmod_u32(BigInt *a, uint32_t d)
+{
+    assert(d != 0 && "bi_divmod_u32 by zero");
+    uint64_t rem = 0;
+    for (size_t i = a->len; i-- > 0;) {
+        uint64_t cur = (rem << 32) | a->limbs[i];
+        a->limbs[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    bi_trim(a);
+    return (uint32_t)rem;
+}
+
+uint32_t bi_mod_u32(const BigInt *a, uint32_t d)
+{
+    assert(d != 0 && "bi_mod_u32 by zero");
+    uint64_t rem = 0;
+    for (size_t i = a->len; i-- > 0;)
+        rem = ((rem << 32) | a->limbs[i]) % d;
+    return (uint32_t)rem;
+}
+
+int bi_cmp_u64(const BigInt *a, uint64_t v)
+{
+    for (size_t i = a->len; i-- > 2;)
+        if (a->limbs[i]) return 1;
+    uint64_t x = a->limbs[0];
+    if (a->len > 1) x |= (uint64_t)a->limbs[1] << 32;
+    return (x > v) - (x < v);
+}
@@ -0,0 +1,89 @@
+#include "chacha20.h"
+#include <string.h>
+
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+static uint32_t load_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QR(a, b, c, d)                     \
+    a += b; d ^= a; d = ROTL(d, 16);       \
+    c += d; b ^= c; b = ROTL(b, 12);       \
+    a += b; d ^= a; d = ROTL(d, 8);        \
+    c += d; b ^= c; b = ROTL(b, 7)
+
+// Four consecutive blocks (counters state[12] .. state[12]+3), one per lane.
+static void chacha20_blocks4(const uint32_t state[16], uint8_t out[256])
+{
+    u32x4 x[16], orig[16];
+    for (int i = 0; i < 16; ++i) {
+        x[i] = (u32x4){ state[i], state[i], state[i], state[i] };
+    }
+    x[12] += (u32x4){ 0, 1, 2, 3 };
+    memcpy(orig, x, sizeof x);
+
+    for (int r = 0; r < 10; ++r) {
+        QR(x[0], x[4], x[8],  x[12]);
+        QR(x[1], x[5], x[9],  x[13]);
+        QR(x[2], x[6], x[10], x[14]);
+        QR(x[3], x[7], x[11], x[15]);
+        QR(x[0], x[5], x[10], x[15]);
+        QR(x[1], x[6], x[11], x[12]);
+        QR(x[2], x[7], x[8],  x[13]);
+        QR(x[3], x[4], x[9],  x[14]);
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        x[i] += orig[i];
+        for (int lane = 0; lane < 4; ++lane) {
+            store_le32(out + 64 * lane + 4 * i, x[i][lane]);
+        }
+    }
+}
+
+
+void chacha20_init(ChaCha20 *c, const uint8_t key[CHACHA20_KEY_SIZE],
+                   const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter)
+{
+    c->state[0] = 0x61707865; c->state[1] = 0x3320646e;   // "expand 32-byte k"
+    c->state[2] = 0x79622d32; c->state[3] = 0x6b206574;
+    for (int i = 0; i < 8; ++i) c->state[4 + i] = load_le32(key + 4 * i);
+    c->state[12] = counter;
+    for (int i = 0; i < 3; ++i) c->state[13 + i] = load_le32(nonce + 4 * i);
+    c->ks_pos = c->ks_len = 0;
+}
+
+void chacha20_xor(ChaCha20 *c, uint8_t *out, const uint8_t *in, size_t len)
+{
+    // Finish keystream left over from the previous call.
+    while (len > 0 && c->ks_pos < c->ks_len) {
+        *out++ = *in++ ^ c->ks[c->ks_pos++];
+        len--;
+    }
+
+    // Bulk: four blocks straight into the output.
+    uint8_t ks[256];
+    while (len >= sizeof ks) {
+        chacha20_blocks4(c->state, ks);
+        c->state[12] += 4;
+        for (size_t i = 0; i < sizeof ks; ++i) out[i] = in[i] ^ ks[i];
+        out += sizeof ks; in += sizeof ks; len -= sizeof ks;
+    }
+
+    if (len > 0) {
+        chacha20_blocks4(c->state, c->ks);
+        c->state[12] += 4;
+        c->ks_len = sizeof c->ks;
+        for (c->ks_pos = 0; c->ks_pos < len; ++c->ks_pos) {
+            out[c->ks_pos] = in[c->ks_pos] ^ c->ks[c->ks_pos];
+        }
+    }
+}
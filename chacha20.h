@@ -0,0 +1,28 @@
+#ifndef CHACHA20_H
+#define CHACHA20_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* ChaCha20 stream cipher (RFC 8439: 256-bit key, 96-bit nonce, 32-bit
+ * block counter). Used as the bulk cipher of the hybrid mode. Keystream
+ * is produced four blocks at a time with GCC vector extensions, so the
+ * compiler can keep the four blocks in SIMD registers.
+ */
+#define CHACHA20_KEY_SIZE   32
+#define CHACHA20_NONCE_SIZE 12
+
+typedef struct {
+    uint32_t state[16];
+    uint8_t  ks[256];       // unused keystream from the last partial call
+    size_t   ks_pos;
+    size_t   ks_len;
+} ChaCha20;
+
+void chacha20_init(ChaCha20 *c, const uint8_t key[CHACHA20_KEY_SIZE],
+                   const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter);
+
+// out = in XOR keystream; may be called repeatedly with any lengths, and
+// out may equal in.
+void chacha20_xor(ChaCha20 *c, uint8_t *out, const uint8_t *in, size_t len);
+
+#endif
@@ -0,0 +1,190 @@
+#include "container.h"
+#include <string.h>
+
+void ct_put_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);  p[3] = (unsigned char)v;
+}
+
+void ct_put_be64(unsigned char *p, uint64_t v)
+{
+    ct_put_be32(p, (uint32_t)(v >> 32));
+    ct_put_be32(p + 4, (uint32_t)v);
+}
+
+uint32_t ct_get_be32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8)  |  (uint32_t)p[3];
+}
+
+uint64_t ct_get_be64(const unsigned char *p)
+{
+    return ((uint64_t)ct_get_be32(p) << 32) | ct_get_be32(p + 4);
+}
+
+
+uint64_t ct_key_id(const BigInt *n)
+{
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a offset basis
+    size_t bytes = (bi_bitlen(n) + 7) / 8;
+    for (size_t i = bytes; i-- > 0;) {
+        unsigned char b = (i / 4 < n->len) ? (unsigned char)(n->limbs[i / 4] >> ((i % 4) * 8)) : 0;
+        h ^= b;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void ct_header_init(CtHeader *h, const BigInt *n)
+{
+    size_t bits = bi_bitlen(n);
+    h->key_id     = ct_key_id(n);
+    h->mod_bytes  = (uint32_t)((bits + 7) / 8);
+    h->block_size = (uint32_t)((bits - 1) / 8);
+    h->flags      = 0;
+}
+
+
+void ct_encode_header(unsigned char out[CT_HEADER_SIZE], const CtHeader *h)
+{
+    memset(out, 0, CT_HEADER_SIZE);
+    memcpy(out, CT_MAGIC, 8);
+    ct_put_be64(out + 8,  h->key_id);
+    ct_put_be32(out + 16, h->mod_bytes);
+    ct_put_be32(out + 20, h->block_size);
+    ct_put_be32(out + 24, h->flags);
+}
+
+bool ct_decode_header(const unsigned char in[CT_HEADER_SIZE], CtHeader *h)
+{
+    if (memcmp(in, CT_MAGIC, 8) != 0) return false;
+    h->key_id     = ct_get_be64(in + 8);
+    h->mod_bytes  = ct_get_be32(in + 16);
+    h->block_size = ct_get_be32(in + 20);
+    h->flags      = ct_get_be32(in + 24);
+    return true;
+}
+
+void ct_encode_trailer(unsigned char out[CT_TRAILER_SIZE], const CtTrailer *t)
+{
+    memset(out, 0, CT_TRAILER_SIZE);
+    memcpy(out, CT_TRAILER_TAG, 8);
+    ct_put_be64(out + 8,  t->nblocks);
+    ct_put_be32(out + 16, t->last_len);
+}
+
+bool ct_decode_trailer(const unsigned char in[CT_TRAILER_SIZE], CtTrailer *t)
+{
+    if (memcmp(in, CT_TRAILER_TAG, 8) != 0) return false;
+    t->nblocks  = ct_get_be64(in + 8);
+    t->last_len = ct_get_be32(in + 16);
+    return true;
+}
+
+
+bool ct_validate(const CtHeader *h, const CtTrailer *t, const BigInt *n, uint64_t file_size)
+{
+    CtHeader want;
+    ct_header_init(&want, n);
+    if (h->key_id != want.key_id) {
+        fprintf(stderr, "Error: Ciphertext was produced for a different key (key id %016llx, expected %016llx).\n",
+                (unsigned long long)h->key_id, (unsigned long long)want.key_id);
+        return false;
+    }
+    if (h->flags & ~CT_FLAG_LZ) {
+        fprintf(stderr, "Error: Container uses unsupported flags %08x.\n", h->flags);
+        return false;
+    }
+    if (h->mod_bytes != want.mod_bytes || h->block_size != want.block_size) {
+        fprintf(stderr, "Error: Container geometry (%u/%u bytes) does not match the key (%u/%u bytes).\n",
+                h->mod_bytes, h->block_size, want.mod_bytes, want.block_size);
+        return false;
+    }
+    if (file_size < CT_HEADER_SIZE + CT_TRAILER_SIZE ||
+        t->nblocks > (file_size - CT_HEADER_SIZE - CT_TRAILER_SIZE) / h->mod_bytes ||
+        CT_HEADER_SIZE + t->nblocks * h->mod_bytes + CT_TRAILER_SIZE != file_size) {
+        fprintf(stderr, "Error: Container size does not match its block count (%llu blocks).\n",
+                (unsigned long long)t->nblocks);
+        return false;
+    }
+    if ((t->nblocks == 0 && t->last_len != 0) ||
+        (t->nblocks > 0 && (t->last_len == 0 || t->last_len > h->block_size))) {
+        fprintf(stderr, "Error: Invalid last block length %u in container trailer.\n", t->last_len);
+        return false;
+    }
+    return true;
+}
+
+
+uint64_t ct_block_offset(const CtHeader *h, uint64_t idx)
+{
+    return CT_HEADER_SIZE + idx * h->mod_bytes;
+}
+
+uint64_t ct_plain_size(const CtHeader *h, const CtTrailer *t)
+{
+    if (t->nblocks == 0) return 0;
+    return (t->nblocks - 1) * h->block_size + t->last_len;
+}
+
+uint32_t ct_block_len(const CtHeader *h, const CtTrailer *t, uint64_t idx)
+{
+    return (idx + 1 == t->nblocks) ? t->last_len : h->block_size;
+}
+
+
+void ct_encode_part(unsigned char out[CT_PART_HEADER_SIZE], const CtPart *p)
+{
+    memset(out, 0, CT_PART_HEADER_SIZE);
+    memcpy(out, CT_PART_MAGIC, 8);
+    ct_put_be64(out + 8,  p->hdr.key_id);
+    ct_put_be32(out + 16, p->hdr.mod_bytes);
+    ct_put_be32(out + 20, p->hdr.block_size);
+    ct_put_be32(out + 24, p->kind);
+    ct_put_be32(out + 28, p->shard);
+    ct_put_be32(out + 32, p->shards);
+    ct_put_be32(out + 36, p->whole.last_len);
+    ct_put_be64(out + 40, p->first_block);
+    ct_put_be64(out + 48, p->nblocks);
+    ct_put_be64(out + 56, p->whole.nblocks);
+}
+
+bool ct_decode_part(const unsigned char in[CT_PART_HEADER_SIZE], CtPart *p)
+{
+    if (memcmp(in, CT_PART_MAGIC, 8) != 0) return false;
+    p->hdr.key_id       = ct_get_be64(in + 8);
+    p->hdr.mod_bytes    = ct_get_be32(in + 16);
+    p->hdr.block_size   = ct_get_be32(in + 20);
+    p->hdr.flags        = 0;
+    p->kind             = ct_get_be32(in + 24);
+    p->shard            = ct_get_be32(in + 28);
+    p->shards           = ct_get_be32(in + 32);
+    p->whole.last_len   = ct_get_be32(in + 36);
+    p->first_block      = ct_get_be64(in + 40);
+    p->nblocks          = ct_get_be64(in + 48);
+    p->whole.nblocks    = ct_get_be64(in + 56);
+
+    uint64_t lo, hi;
+    if (p->kind > CT_PART_PLAIN || p->shard >= p->shards || p->hdr.mod_bytes == 0 ||
+        p->hdr.block_size == 0 || p->whole.last_len > p->hdr.block_size) return false;
+    ct_shard_range(p->whole.nblocks, p->shards, p->shard, &lo, &hi);
+    return p->first_block == lo && p->nblocks == hi - lo;
+}
+
+void ct_shard_range(uint64_t total, uint32_t shards, uint32_t shard, uint64_t *lo, uint64_t *hi)
+{
+    // The first total % shards shards get one extra block.
+    uint64_t base = total / shards, extra = total % shards;
+    *lo = shard * base + (shard < extra ? shard : extra);
+    *hi = *lo + base + (shard < extra ? 1 : 0);
+}
+
+uint64_t ct_part_payload(const CtPart *p)
+{
+    if (p->kind == CT_PART_CIPHER) return p->nblocks * p->hdr.mod_bytes;
+    uint64_t end = p->first_block + p->nblocks;
+    if (p->nblocks == 0) return 0;
+    return (end - p->first_block - 1) * p->hdr.block_size + ct_block_len(&p->hdr, &p->whole, end - 1);
+}
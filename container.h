@@ -0,0 +1,91 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+#include "BigInt.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Binary ciphertext container.
+ *
+ *   header   CT_HEADER_SIZE bytes   magic, key id, modulus bytes, block size
+ *   blocks   nblocks * mod_bytes    each ciphertext big-endian, zero-padded
+ *   trailer  CT_TRAILER_SIZE bytes  block count, plaintext length of last block
+ *
+ * All integers are big-endian. Every block has the same width, so block i
+ * starts at CT_HEADER_SIZE + i * mod_bytes and covers plaintext bytes
+ * [i * block_size, i * block_size + block_size).
+ */
+#define CT_MAGIC        "RSABLK1"     // 8 bytes including the NUL
+#define CT_TRAILER_TAG  "RSAEND1"
+#define CT_HEADER_SIZE  32
+#define CT_TRAILER_SIZE 24
+
+typedef struct {
+    uint64_t key_id;       // ct_key_id() of the modulus
+    uint32_t mod_bytes;    // width of one ciphertext block
+    uint32_t block_size;   // plaintext bytes per full block
+    uint32_t flags;        // CT_FLAG_*; unknown bits are rejected
+} CtHeader;
+
+#define CT_FLAG_LZ 1u      // blocks carry an lz.h frame stream of the plaintext (enc --compress)
+
+typedef struct {
+    uint64_t nblocks;
+    uint32_t last_len;     // plaintext bytes in the last block (0 if no blocks)
+} CtTrailer;
+
+uint64_t ct_key_id(const BigInt *n);                 // FNV-1a of n's big-endian bytes
+void     ct_header_init(CtHeader *h, const BigInt *n);
+
+void ct_encode_header (unsigned char out[CT_HEADER_SIZE],  const CtHeader *h);
+bool ct_decode_header (const unsigned char in[CT_HEADER_SIZE], CtHeader *h);
+void ct_encode_trailer(unsigned char out[CT_TRAILER_SIZE], const CtTrailer *t);
+bool ct_decode_trailer(const unsigned char in[CT_TRAILER_SIZE], CtTrailer *t);
+
+// Check that the header belongs to this modulus and that the file size
+// agrees with header + blocks + trailer. Prints the reason on failure.
+bool ct_validate(const CtHeader *h, const CtTrailer *t, const BigInt *n, uint64_t file_size);
+
+/* Shard part files (enc/dec --shards K --shard i, joined by `merge`).
+ *
+ *   header   CT_PART_HEADER_SIZE bytes  magic, the container header fields,
+ *                                       kind, shard i of K, this part's
+ *                                       block range, the whole file's trailer
+ *   payload  CT_PART_CIPHER: the part's ciphertext blocks, as in a container
+ *            CT_PART_PLAIN:  the part's plaintext bytes
+ *
+ * Shard i owns blocks [lo, hi) from ct_shard_range(), so concatenating the
+ * payloads of shards 0..K-1 gives exactly the single-process output.
+ */
+#define CT_PART_MAGIC       "RSAPRT1"
+#define CT_PART_HEADER_SIZE 64
+
+enum { CT_PART_CIPHER = 0, CT_PART_PLAIN = 1 };
+
+typedef struct {
+    CtHeader  hdr;
+    CtTrailer whole;        // block count and last length of the full file
+    uint32_t  kind;         // CT_PART_*
+    uint32_t  shard, shards;
+    uint64_t  first_block;
+    uint64_t  nblocks;
+} CtPart;
+
+void ct_encode_part(unsigned char out[CT_PART_HEADER_SIZE], const CtPart *p);
+bool ct_decode_part(const unsigned char in[CT_PART_HEADER_SIZE], CtPart *p);
+
+// Blocks [*lo, *hi) of `total` that belong to shard `shard` of `shards`.
+void     ct_shard_range(uint64_t total, uint32_t shards, uint32_t shard, uint64_t *lo, uint64_t *hi);
+// Bytes of payload a part carries.
+uint64_t ct_part_payload(const CtPart *p);
+
+// Big-endian field helpers shared with the other on-disk formats.
+void     ct_put_be32(unsigned char *p, uint32_t v);
+void     ct_put_be64(unsigned char *p, uint64_t v);
+uint32_t ct_get_be32(const unsigned char *p);
+uint64_t ct_get_be64(const unsigned char *p);
+
+uint64_t ct_block_offset(const CtHeader *h, uint64_t idx);
+uint64_t ct_plain_size  (const CtHeader *h, const CtTrailer *t);
+uint32_t ct_block_len   (const CtHeader *h, const CtTrailer *t, uint64_t idx);
+
+#endif
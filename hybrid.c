@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hybrid.h"
+#include "chacha20.h"
+#include "container.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HYB_SECRET_SIZE (CHACHA20_KEY_SIZE + CHACHA20_NONCE_SIZE)
+#define HYB_CHUNK       (1 << 20)
+
+static bool random_bytes(unsigned char *buf, size_t len)
+{
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (!f) { perror("/dev/urandom"); return false; }
+    bool ok = fread(buf, 1, len, f) == len;
+    fclose(f);
+    if (!ok) fprintf(stderr, "Error: Short read from /dev/urandom.\n");
+    return ok;
+}
+
+// Streams in -> out through the cipher, stopping after `limit` bytes.
+// `pos` is the payload offset of the first byte; nothing past
+// HYB_MAX_PAYLOAD is processed, since the block counter would wrap.
+static int xor_stream(ChaCha20 *cc, FILE *in, FILE *out, uint64_t pos, uint64_t limit)
+{
+    unsigned char *buf = malloc(HYB_CHUNK);
+    if (!buf) { perror("malloc hybrid buffer"); return -1; }
+
+    int rc = 0;
+    while (limit > 0) {
+        size_t want = (limit < HYB_CHUNK) ? (size_t)limit : HYB_CHUNK;
+        size_t got = fread(buf, 1, want, in);
+        if (got == 0) {
+            if (ferror(in)) { fprintf(stderr, "Error reading input file\n"); rc = -1; }
+            break;
+        }
+        if (got > HYB_MAX_PAYLOAD - pos) {
+            fprintf(stderr, "Error: Hybrid payload exceeds the 256 GiB limit of the ChaCha20 block counter.\n");
+            rc = -1; break;
+        }
+        chacha20_xor(cc, buf, buf, got);
+        if (fwrite(buf, 1, got, out) != got) {
+            fprintf(stderr, "Error writing output file.\n");
+            rc = -1; break;
+        }
+        limit -= got;
+        pos += got;
+    }
+    free(buf);
+    return rc;
+}
+
+
+int hybrid_encrypt_stream(FILE *in, FILE *out, const RSAKey *pub)
+{
+    CtHeader geo;
+    ct_header_init(&geo, pub->n);
+    uint32_t wrap_blocks = (HYB_SECRET_SIZE + geo.block_size - 1) / geo.block_size;
+
+    unsigned char secret[HYB_SECRET_SIZE];
+    if (!random_bytes(secret, sizeof secret)) return -1;
+
+    unsigned char hdr[HYB_HEADER_SIZE] = {0};
+    memcpy(hdr, HYB_MAGIC, 8);
+    ct_put_be64(hdr + 8,  geo.key_id);
+    ct_put_be32(hdr + 16, geo.mod_bytes);
+    ct_put_be32(hdr + 20, geo.block_size);
+    ct_put_be32(hdr + 24, wrap_blocks);
+    if (fwrite(hdr, 1, sizeof hdr, out) != sizeof hdr) {
+        fprintf(stderr, "Error writing output file.\n");
+        return -1;
+    }
+
+    unsigned char *wrapped = malloc(geo.mod_bytes);
+    if (!wrapped) { perror("malloc wrapped key"); return -1; }
+    for (uint32_t i = 0; i < wrap_blocks; ++i) {
+        size_t pos = (size_t)i * geo.block_size;
+        size_t len = (HYB_SECRET_SIZE - pos < geo.block_size) ? HYB_SECRET_SIZE - pos : geo.block_size;
+        BigInt *m = bi_from_bytes_be(secret + pos, len);
+        BigInt *c = NULL;
+        if (m) rsa_encrypt(m, pub, &c);
+        bool ok = c && bi_to_bytes_be(c, wrapped, geo.mod_bytes) &&
+                  fwrite(wrapped, 1, geo.mod_bytes, out) == geo.mod_bytes;
+        bi_free(m); bi_free(c);
+        if (!ok) {
+            fprintf(stderr, "Error wrapping session key (block %u).\n", i + 1);
+            free(wrapped); return -1;
+        }
+    }
+    free(wrapped);
+
+    ChaCha20 cc;
+    chacha20_init(&cc, secret, secret + CHACHA20_KEY_SIZE, 0);
+    memset(secret, 0, sizeof secret);
+    int rc = xor_stream(&cc, in, out, 0, UINT64_MAX);
+    memset(&cc, 0, sizeof cc);
+    return rc;
+}
+
+
+int hybrid_decrypt_stream(FILE *in, FILE *out, const RSAKey *priv, uint64_t off, uint64_t len)
+{
+    if (off >= HYB_MAX_PAYLOAD) {
+        fprintf(stderr, "Error: --range offset is past the 256 GiB limit of a hybrid payload.\n");
+        return -1;
+    }
+    unsigned char hdr[HYB_HEADER_SIZE];
+    if (fread(hdr, 1, sizeof hdr, in) != sizeof hdr || memcmp(hdr, HYB_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: Invalid hybrid file header.\n");
+        return -1;
+    }
+
+    CtHeader want;
+    ct_header_init(&want, priv->n);
+    uint64_t key_id      = ct_get_be64(hdr + 8);
+    uint32_t mod_bytes   = ct_get_be32(hdr + 16);
+    uint32_t block_size  = ct_get_be32(hdr + 20);
+    uint32_t wrap_blocks = ct_get_be32(hdr + 24);
+    if (key_id != want.key_id || mod_bytes != want.mod_bytes || block_size != want.block_size) {
+        fprintf(stderr, "Error: Hybrid file was produced for a different key (key id %016llx, expected %016llx).\n",
+                (unsigned long long)key_id, (unsigned long long)want.key_id);
+        return -1;
+    }
+    if (wrap_blocks != (HYB_SECRET_SIZE + block_size - 1) / block_size) {
+        fprintf(stderr, "Error: Invalid wrapped key size in hybrid header.\n");
+        return -1;
+    }
+
+    unsigned char secret[HYB_SECRET_SIZE];
+    unsigned char *wrapped = malloc(mod_bytes);
+    if (!wrapped) { perror("malloc wrapped key"); return -1; }
+    for (uint32_t i = 0; i < wrap_blocks; ++i) {
+        size_t pos = (size_t)i * block_size;
+        size_t n = (HYB_SECRET_SIZE - pos < block_size) ? HYB_SECRET_SIZE - pos : block_size;
+        BigInt *c = NULL, *m = NULL;
+        bool ok = fread(wrapped, 1, mod_bytes, in) == mod_bytes &&
+                  (c = bi_from_bytes_be(wrapped, mod_bytes)) != NULL;
+        if (ok) rsa_decrypt(c, priv, &m);
+        ok = ok && m && bi_to_bytes_be(m, secret + pos, n);
+        bi_free(c); bi_free(m);
+        if (!ok) {
+            fprintf(stderr, "Error unwrapping session key (block %u).\n", i + 1);
+            free(wrapped); return -1;
+        }
+    }
+    free(wrapped);
+
+    // Random access: jump to the keystream block holding `off` and
+    // discard the bytes before it.
+    ChaCha20 cc;
+    chacha20_init(&cc, secret, secret + CHACHA20_KEY_SIZE, (uint32_t)(off / 64));
+    memset(secret, 0, sizeof secret);
+    int rc = 0;
+    if (off > 0) {
+        if (fseeko(in, (off_t)off, SEEK_CUR) != 0) {
+            fprintf(stderr, "Error: --range needs a seekable hybrid input.\n");
+            rc = -1;
+        } else {
+            unsigned char skip[64] = {0};
+            chacha20_xor(&cc, skip, skip, (size_t)(off % 64));
+        }
+    }
+    if (rc == 0) rc = xor_stream(&cc, in, out, off, len);
+    memset(&cc, 0, sizeof cc);
+    return rc;
+}
@@ -0,0 +1,32 @@
+#ifndef HYBRID_H
+#define HYBRID_H
+#include "rsa.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Hybrid encryption: a random ChaCha20 key and nonce are RSA-encrypted
+ * into the header, and the payload is ChaCha20-encrypted with them. Only
+ * HYB_SECRET_SIZE bytes go through RSA, so throughput is bounded by the
+ * stream cipher rather than by modexp.
+ *
+ *   header   HYB_HEADER_SIZE bytes   magic, key id, modulus bytes, block size, wrap blocks
+ *   wrapped  wrap_blocks * mod_bytes the secret, split into RSA blocks (fixed width)
+ *   payload  plaintext length        plaintext XOR ChaCha20 keystream (counter 0)
+ *
+ * This mode provides confidentiality only; the payload is not authenticated.
+ * The 32-bit ChaCha20 block counter limits the payload to HYB_MAX_PAYLOAD
+ * (256 GiB): longer input, or a --range starting past it, is an error
+ * rather than a keystream that wraps around.
+ */
+#define HYB_MAGIC       "HYBRSA1"    // 8 bytes including the NUL
+#define HYB_HEADER_SIZE 32
+#define HYB_MAX_PAYLOAD ((uint64_t)64 << 32)   // 2^32 keystream blocks of 64 bytes
+
+// 0 on success. Writes a complete hybrid file from `in` to `out`.
+int hybrid_encrypt_stream(FILE *in, FILE *out, const RSAKey *pub);
+
+// 0 on success. Recovers plaintext bytes [off, off + len) (len may be
+// UINT64_MAX for "to the end"); `in` must be positioned at the header.
+int hybrid_decrypt_stream(FILE *in, FILE *out, const RSAKey *priv, uint64_t off, uint64_t len);
+
+#endif
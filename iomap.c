@@ -0,0 +1,65 @@
+#define _POSIX_C_SOURCE 200809L
+#include "iomap.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Error path once m->fd is open: the descriptor is closed and forgotten,
+// so a later iomap_close (callers check fd >= 0) cannot close it again.
+static bool fail(IoMap *m, const char *what)
+{
+    if (what) perror(what);
+    close(m->fd);
+    m->fd   = -1;
+    m->data = NULL;
+    m->size = 0;
+    return false;
+}
+
+bool iomap_open_read(IoMap *m, const char *path)
+{
+    m->data = NULL; m->size = 0;
+    m->fd = open(path, O_RDONLY);
+    if (m->fd < 0) { perror(path); return false; }
+
+    struct stat st;
+    if (fstat(m->fd, &st) != 0) return fail(m, path);
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Error: %s is not a regular file and cannot be mapped.\n", path);
+        return fail(m, NULL);
+    }
+    m->size = (size_t)st.st_size;
+    if (m->size == 0) return true;
+
+    void *p = mmap(NULL, m->size, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (p == MAP_FAILED) return fail(m, "mmap input");
+    posix_madvise(p, m->size, POSIX_MADV_SEQUENTIAL);
+    m->data = p;
+    return true;
+}
+
+bool iomap_create(IoMap *m, const char *path, size_t size)
+{
+    m->data = NULL; m->size = size;
+    m->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m->fd < 0) { perror(path); return false; }
+    if (ftruncate(m->fd, (off_t)size) != 0) return fail(m, "ftruncate output");
+    if (size == 0) return true;
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+    if (p == MAP_FAILED) return fail(m, "mmap output");
+    m->data = p;
+    return true;
+}
+
+bool iomap_close(IoMap *m)
+{
+    bool ok = true;
+    if (m->data && munmap(m->data, m->size) != 0) { perror("munmap"); ok = false; }
+    if (m->fd >= 0 && close(m->fd) != 0) { perror("close"); ok = false; }
+    m->data = NULL;
+    m->fd = -1;
+    return ok;
+}
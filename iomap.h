@@ -0,0 +1,21 @@
+#ifndef IOMAP_H
+#define IOMAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Whole-file memory mappings for the --mmap I/O mode. Input is mapped
+ * read-only; output is created at its final size with ftruncate and
+ * mapped shared, so blocks can be written straight to their place in
+ * the file without going through stdio.
+ */
+typedef struct {
+    unsigned char *data;   // NULL for an empty file
+    size_t         size;
+    int            fd;
+} IoMap;
+
+bool iomap_open_read(IoMap *m, const char *path);
+bool iomap_create   (IoMap *m, const char *path, size_t size);
+bool iomap_close    (IoMap *m);   // false if unmapping or closing failed
+
+#endif
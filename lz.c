@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lz.h"
+#include "container.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Greedy single-probe matcher: a hash of the next four bytes finds the
+ * last position with the same hash, and a match is taken if at least
+ * LZ_MIN_MATCH bytes agree. Runs of literals make the scan skip ahead
+ * faster, so incompressible data costs little more than a copy.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_SKIP_SHIFT 5
+
+static uint32_t hash4(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes the 255-run tail of a length field whose nibble was 15.
+static size_t put_length(unsigned char *out, size_t op, size_t cap, size_t rem)
+{
+    while (rem >= 255) {
+        if (op >= cap) return SIZE_MAX;
+        out[op++] = 255;
+        rem -= 255;
+    }
+    if (op >= cap) return SIZE_MAX;
+    out[op++] = (unsigned char)rem;
+    return op;
+}
+
+// One sequence: literals lit[0..nlit), then a match unless mlen is 0.
+static size_t put_sequence(unsigned char *out, size_t op, size_t cap, const unsigned char *lit,
+                           size_t nlit, size_t off, size_t mlen)
+{
+    size_t mcode = mlen ? mlen - LZ_MIN_MATCH : 0;
+    if (op >= cap) return SIZE_MAX;
+    out[op++] = (unsigned char)(((nlit < 15 ? nlit : 15) << 4) | (mcode < 15 ? mcode : 15));
+    if (nlit >= 15 && (op = put_length(out, op, cap, nlit - 15)) == SIZE_MAX) return SIZE_MAX;
+    if (nlit > cap - op) return SIZE_MAX;
+    memcpy(out + op, lit, nlit);
+    op += nlit;
+    if (mlen == 0) return op;
+    if (cap - op < 2) return SIZE_MAX;
+    out[op++] = (unsigned char)off;
+    out[op++] = (unsigned char)(off >> 8);
+    if (mcode >= 15) op = put_length(out, op, cap, mcode - 15);
+    return op;
+}
+
+size_t lz_compress(const unsigned char *in, size_t n, unsigned char *out, size_t cap)
+{
+    uint32_t table[1u << LZ_HASH_BITS];
+    memset(table, 0, sizeof table);
+    size_t i = 0, anchor = 0, op = 0;
+
+    while (n >= LZ_MIN_MATCH && i <= n - LZ_MIN_MATCH) {
+        uint32_t h = hash4(in + i);
+        size_t cand = table[h];
+        table[h] = (uint32_t)i;
+        if (cand < i && i - cand <= 0xFFFF && memcmp(in + cand, in + i, LZ_MIN_MATCH) == 0) {
+            size_t len = LZ_MIN_MATCH;
+            while (i + len < n && in[cand + len] == in[i + len]) len++;
+            op = put_sequence(out, op, cap, in + anchor, i - anchor, i - cand, len);
+            if (op == SIZE_MAX) return 0;
+            i += len;
+            anchor = i;
+            // Seed the table inside the match so the next one can chain on it
+            if (i >= 2 && i - 2 <= n - LZ_MIN_MATCH) table[hash4(in + i - 2)] = (uint32_t)(i - 2);
+        } else {
+            i += 1 + ((i - anchor) >> LZ_SKIP_SHIFT);
+        }
+    }
+    op = put_sequence(out, op, cap, in + anchor, n - anchor, 0, 0);
+    return (op == SIZE_MAX || op >= cap) ? 0 : op;
+}
+
+// Reads the 255-run tail of a length field; false if it runs off the end.
+static bool get_length(const unsigned char *in, size_t n, size_t *ip, size_t *len, size_t limit)
+{
+    unsigned char b;
+    do {
+        if (*ip >= n) return false;
+        b = in[(*ip)++];
+        *len += b;
+        if (*len > limit) return false;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_decompress(const unsigned char *in, size_t n, unsigned char *out, size_t out_len)
+{
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        unsigned token = in[ip++];
+        size_t nlit = token >> 4;
+        if (nlit == 15 && !get_length(in, n, &ip, &nlit, out_len)) return false;
+        if (nlit > n - ip || nlit > out_len - op) return false;
+        memcpy(out + op, in + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == n) break;                     // literals-only last sequence
+
+        if (n - ip < 2) return false;
+        size_t off = in[ip] | (size_t)in[ip + 1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !get_length(in, n, &ip, &mlen, out_len)) return false;
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > op || mlen > out_len - op) return false;
+        if (off >= mlen) {
+            memcpy(out + op, out + op - off, mlen);
+        } else {
+            for (size_t k = 0; k < mlen; ++k) out[op + k] = out[op + k - off];   // overlapping run
+        }
+        op += mlen;
+    }
+    return op == out_len;
+}
+
+size_t lz_frame_encode(const unsigned char *raw, size_t n, unsigned char out[LZ_FRAME_MAX])
+{
+    size_t body = lz_compress(raw, n, out + LZ_FRAME_HEADER, n);
+    uint32_t tag = (uint32_t)body;
+    if (body == 0) {
+        memcpy(out + LZ_FRAME_HEADER, raw, n);
+        body = n;
+        tag  = (uint32_t)n | LZ_STORED;
+    }
+    ct_put_be32(out, (uint32_t)n);
+    ct_put_be32(out + 4, tag);
+    return LZ_FRAME_HEADER + body;
+}
+
+
+void lz_decoder_init(LzDecoder *d, int (*sink)(void *ctx, const unsigned char *p, size_t n), void *ctx)
+{
+    d->sink      = sink;
+    d->ctx       = ctx;
+    d->have      = 0;
+    d->need      = LZ_FRAME_HEADER;
+    d->raw_bytes = 0;
+}
+
+// A whole frame is in buf: decodes it and points *out at the raw bytes.
+static bool decode_frame(LzDecoder *d, const unsigned char **out, size_t *len)
+{
+    size_t raw_len = ct_get_be32(d->buf), body = d->need - LZ_FRAME_HEADER;
+    *out = d->buf + LZ_FRAME_HEADER;
+    *len = raw_len;
+    if (ct_get_be32(d->buf + 4) & LZ_STORED) return body == raw_len;
+    *out = d->raw;
+    return lz_decompress(d->buf + LZ_FRAME_HEADER, body, d->raw, raw_len);
+}
+
+int lz_decoder_put(LzDecoder *d, const unsigned char *p, size_t n)
+{
+    while (n > 0) {
+        size_t take = (d->need - d->have < n) ? d->need - d->have : n;
+        memcpy(d->buf + d->have, p, take);
+        d->have += take;
+        p += take;
+        n -= take;
+        if (d->have < d->need) break;
+
+        if (d->need == LZ_FRAME_HEADER) {
+            uint32_t raw_len = ct_get_be32(d->buf), tag = ct_get_be32(d->buf + 4);
+            uint32_t body = tag & ~LZ_STORED;
+            if (raw_len == 0 || raw_len > LZ_FRAME_SIZE || body == 0 || body > raw_len) {
+                fprintf(stderr, "Error: Corrupt compressed frame header.\n");
+                return -1;
+            }
+            d->need += body;
+            continue;
+        }
+        const unsigned char *raw;
+        size_t raw_len;
+        if (!decode_frame(d, &raw, &raw_len)) {
+            fprintf(stderr, "Error: Corrupt compressed frame at output offset %llu.\n",
+                    (unsigned long long)d->raw_bytes);
+            return -1;
+        }
+        if (d->sink(d->ctx, raw, raw_len) != 0) return -1;
+        d->raw_bytes += raw_len;
+        d->have = 0;
+        d->need = LZ_FRAME_HEADER;
+    }
+    return 0;
+}
+
+int lz_decoder_finish(LzDecoder *d)
+{
+    if (d->have == 0) return 0;
+    fprintf(stderr, "Error: Compressed stream ends inside a frame.\n");
+    return -1;
+}
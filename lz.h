@@ -0,0 +1,52 @@
+#ifndef LZ_H
+#define LZ_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* In-tree LZ77 compressor for `enc --compress`.
+ *
+ * The stream is a sequence of independent frames, so it is produced and
+ * consumed in constant memory:
+ *
+ *   frame    LZ_FRAME_HEADER bytes  raw length (1..LZ_FRAME_SIZE), body length
+ *                                   with LZ_STORED set if the body is raw
+ *            body                   LZ sequences, or the raw bytes
+ *
+ * Lengths are big-endian. A body is a run of sequences in the LZ4 block
+ * layout: a token (literal count, match length - 4), extra length bytes
+ * of 255 each plus one final byte when a field is 15, the literals, then
+ * a 2-byte little-endian match offset. The last sequence has literals only.
+ */
+#define LZ_FRAME_SIZE   (1u << 16)     // raw bytes per frame; offsets fit 16 bits
+#define LZ_FRAME_HEADER 8
+#define LZ_FRAME_MAX    (LZ_FRAME_HEADER + LZ_FRAME_SIZE)   // stored frames bound every frame
+#define LZ_STORED       0x80000000u
+
+// Compresses in[0..n) into out; returns the body length, or 0 if it would
+// not be shorter than cap bytes.
+size_t lz_compress(const unsigned char *in, size_t n, unsigned char *out, size_t cap);
+// Expands a body into exactly out_len bytes; false if it is malformed.
+bool   lz_decompress(const unsigned char *in, size_t n, unsigned char *out, size_t out_len);
+
+// One frame for raw[0..n), 0 < n <= LZ_FRAME_SIZE; returns its total length.
+size_t lz_frame_encode(const unsigned char *raw, size_t n, unsigned char out[LZ_FRAME_MAX]);
+
+/* Incremental frame reader: takes the stream in pieces of any size and
+ * passes each decoded frame to sink, which returns 0 on success.
+ */
+typedef struct {
+    int          (*sink)(void *ctx, const unsigned char *p, size_t n);
+    void          *ctx;
+    size_t         have;                  // bytes of the current frame in buf
+    size_t         need;                  // its total length once the header is in
+    uint64_t       raw_bytes;             // decoded so far
+    unsigned char  buf[LZ_FRAME_MAX];
+    unsigned char  raw[LZ_FRAME_SIZE];
+} LzDecoder;
+
+void lz_decoder_init  (LzDecoder *d, int (*sink)(void *ctx, const unsigned char *p, size_t n), void *ctx);
+int  lz_decoder_put   (LzDecoder *d, const unsigned char *p, size_t n);  // -1: corrupt or sink failed
+int  lz_decoder_finish(LzDecoder *d);                                    // -1: stream ends inside a frame
+
+#endif
@@ -1,9 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
 #include "rsa.h"
+#include "pool.h"
+#include "container.h"
+#include "iomap.h"
+#include "hybrid.h"
+#include "serve.h"
+#include "batch.h"
+#include "shard.h"
+#include "stats.h"
+#include "tune.h"
+#include "lz.h"
+#include "memo.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h> 
 #include <ctype.h>   
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 static BigInt *bytes_to_bigint(const unsigned char *buf, size_t len)
@@ -62,177 +76,618 @@ static void bigint_to_bytes(const BigInt *n,
 }
 
 
-static int encrypt_file(const char *in_path, const char *out_path);
-static int decrypt_file(const char *in_path, const char *out_path);
+typedef enum { FMT_BIN, FMT_HEX } Format;
 
+typedef struct {
+    size_t   nthreads;    // -j N
+    Format   format;      // --format, encryption only (decryption detects it)
+    bool     has_range;   // --range OFF[:LEN], binary decryption only
+    uint64_t range_off;
+    uint64_t range_len;   // UINT64_MAX = to the end
+    bool     use_mmap;    // --mmap, binary format only
+    bool     hybrid;      // --hybrid: RSA-wrapped ChaCha20 key, encryption only
+    uint32_t shards;      // --shards K (0 = off): write only this shard's part
+    uint32_t shard;       // --shard i, 0 <= i < K
+    bool     compress;    // --compress: LZ frames before blocking, encryption only
+    size_t   memo;        // --memo N: cache up to N block results (0 = off)
+    size_t   exp_threads; // --exp-threads T: threads per private-key modexp
+} Options;
+
+static int encrypt_file(const char *in_path, const char *out_path, const Options *opt);
+static int decrypt_file(const char *in_path, const char *out_path, const Options *opt);
+
+// Blocks kept in flight per worker thread by the ordered pool. Together
+// with the stdio buffers this is the whole memory budget of a run, so
+// input of any size is processed in constant memory. `make tune` picks
+// the value (tune.h).
+#define BLOCKS_PER_THREAD BI_BATCH_WIDTH
+#define IO_BUFFER_SIZE    (1 << 20)
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <mode> <input_file> <output_file>\n"
+            "       %s [-j N] serve <socket_path>\n"
+            "       %s [-j N] batch <manifest>\n"
+            "       %s merge <output_file> <part_file>...\n", prog, prog, prog, prog);
+    fprintf(stderr, "  mode: 'enc' (encrypt) or 'dec' (decrypt)\n");
+    fprintf(stderr, "  serve: answer encrypt/decrypt requests on a Unix socket (see serve.h)\n");
+    fprintf(stderr, "  batch: run 'enc|dec <input> <output>' lines from a manifest (see batch.h)\n");
+    fprintf(stderr, "  merge: join the part files of a --shards run into one output (see shard.h)\n");
+    fprintf(stderr, "  -j N               process blocks on N threads (default 1)\n");
+    fprintf(stderr, "  --format bin|hex   ciphertext format for 'enc' (default bin)\n");
+    fprintf(stderr, "  --range OFF[:LEN]  'dec' only: recover LEN plaintext bytes from OFF\n");
+    fprintf(stderr, "  --mmap             map input and output files instead of using stdio\n");
+    fprintf(stderr, "  --hybrid           'enc' only: RSA-wrap a session key, ChaCha20 the payload\n");
+    fprintf(stderr, "  --compress         'enc' only: LZ-compress the input first ('dec' detects it)\n");
+    fprintf(stderr, "  --exp-threads T    split each private-key modexp over T threads (latency)\n");
+    fprintf(stderr, "  --memo N           reuse the results of up to N distinct repeated blocks\n");
+    fprintf(stderr, "  --shards K --shard I  process only the I-th of K block ranges into a part file\n");
+    fprintf(stderr, "  --stats text|json  print operation counts and timings to stderr at exit\n");
+}
+
+static bool parse_range(const char *arg, Options *opt)
+{
+    char *end = NULL;
+    opt->range_off = strtoull(arg, &end, 10);
+    if (end == arg) return false;
+    opt->range_len = UINT64_MAX;
+    if (*end == ':') {
+        const char *len = end + 1;
+        opt->range_len = strtoull(len, &end, 10);
+        if (end == len) return false;
+    }
+    opt->has_range = true;
+    return *end == '\0';
+}
 
 int main(int argc, char **argv)
 {
-    if (argc != 4) {
-        fprintf(stderr,
-                "Usage: %s <mode> <input_file> <output_file>\n", argv[0]);
-        fprintf(stderr, "  mode: 'enc' (encrypt) or 'dec' (decrypt)\n");
+    Options opt = { 1, FMT_BIN, false, 0, UINT64_MAX, false, false, 0, 0, false, 0, 1 };
+    const char *pos[argc];
+    bool has_shard = false;
+    enum { STATS_OFF, STATS_TEXT, STATS_JSON } stats = STATS_OFF;
+    int npos = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0) {
+            char *end = NULL;
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            unsigned long v = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || v == 0) {
+                fprintf(stderr, "Error: Invalid thread count '%s'.\n", argv[i]);
+                return 1;
+            }
+            opt.nthreads = v;
+        } else if (strcmp(argv[i], "--format") == 0) {
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            ++i;
+            if      (strcmp(argv[i], "bin") == 0) opt.format = FMT_BIN;
+            else if (strcmp(argv[i], "hex") == 0) opt.format = FMT_HEX;
+            else {
+                fprintf(stderr, "Error: Invalid format '%s'. Use 'bin' or 'hex'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            ++i;
+            if      (strcmp(argv[i], "text") == 0) stats = STATS_TEXT;
+            else if (strcmp(argv[i], "json") == 0) stats = STATS_JSON;
+            else {
+                fprintf(stderr, "Error: Invalid stats format '%s'. Use 'text' or 'json'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            opt.use_mmap = true;
+        } else if (strcmp(argv[i], "--hybrid") == 0) {
+            opt.hybrid = true;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            opt.compress = true;
+        } else if (strcmp(argv[i], "--exp-threads") == 0) {
+            char *end = NULL;
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            unsigned long v = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || v == 0) {
+                fprintf(stderr, "Error: Invalid thread count '%s'.\n", argv[i]);
+                return 1;
+            }
+            opt.exp_threads = v;
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            char *end = NULL;
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            unsigned long v = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || v == 0) {
+                fprintf(stderr, "Error: Invalid memo size '%s'.\n", argv[i]);
+                return 1;
+            }
+            opt.memo = v;
+        } else if (strcmp(argv[i], "--range") == 0) {
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            if (!parse_range(argv[++i], &opt)) {
+                fprintf(stderr, "Error: Invalid range '%s'. Use OFF or OFF:LEN.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--shards") == 0 || strcmp(argv[i], "--shard") == 0) {
+            bool count = strcmp(argv[i], "--shards") == 0;
+            char *end = NULL;
+            if (i + 1 >= argc) { usage(argv[0]); return 1; }
+            unsigned long v = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || v > UINT32_MAX || (count && v == 0)) {
+                fprintf(stderr, "Error: Invalid shard %s '%s'.\n", count ? "count" : "index", argv[i]);
+                return 1;
+            }
+            if (count) opt.shards = (uint32_t)v;
+            else { opt.shard = (uint32_t)v; has_shard = true; }
+        } else {
+            pos[npos++] = argv[i];
+        }
+    }
+    if ((opt.shards > 0) != has_shard || (opt.shards && opt.shard >= opt.shards)) {
+        fprintf(stderr, "Error: --shards K and --shard I go together, with 0 <= I < K.\n");
         return 1;
     }
+    if (opt.shards && (opt.use_mmap || opt.hybrid || opt.has_range || opt.format != FMT_BIN)) {
+        fprintf(stderr, "Error: --shards works on the binary container and cannot be combined with --mmap, --hybrid, --range or --format.\n");
+        return 1;
+    }
+    if (stats != STATS_OFF) stats_enable();
+    // Huge products inside a run may also split across -j threads (bi_mul),
+    // and --exp-threads splits each decryption over the same pool.
+    pool_shared_set_threads(opt.nthreads > opt.exp_threads ? opt.nthreads : opt.exp_threads);
+    rsa_set_decrypt_threads(opt.exp_threads);
 
-    const char *mode     = argv[1];
-    const char *in_path  = argv[2];
-    const char *out_path = argv[3];
-
-    if (strcmp(mode, "enc") == 0) {
-        return encrypt_file(in_path, out_path);
-    } else if (strcmp(mode, "dec") == 0) {
-        return decrypt_file(in_path, out_path);
+    int rc;
+    if (npos >= 3 && strcmp(pos[0], "merge") == 0) {
+        rc = shard_merge(pos[1], pos + 2, (size_t)(npos - 2)) == 0 ? 0 : 1;
+    } else if (npos == 2 && strcmp(pos[0], "serve") == 0) {
+        rc = serve_run(pos[1], opt.nthreads);
+    } else if (npos == 2 && strcmp(pos[0], "batch") == 0) {
+        rc = batch_run(pos[1], opt.nthreads);
+    } else if (npos != 3) {
+        usage(argv[0]); return 1;
+    } else if (strcmp(pos[0], "enc") == 0) {
+        rc = encrypt_file(pos[1], pos[2], &opt);
+    } else if (strcmp(pos[0], "dec") == 0) {
+        rc = decrypt_file(pos[1], pos[2], &opt);
     } else {
-        fprintf(stderr, "Error: Invalid mode '%s'. Use 'enc' or 'dec'.\n", mode);
+        fprintf(stderr, "Error: Invalid mode '%s'. Use 'enc' or 'dec'.\n", pos[0]);
         return 1;
     }
+
+    // Stats go to stderr: the output file may well be /dev/stdout.
+    if (stats != STATS_OFF) stats_report(stderr, stats == STATS_JSON);
+    return rc;
 }
 
 
-static int encrypt_file(const char *in_path, const char *out_path)
+// stdio reads and writes of the block pipeline, timed for --stats.
+static size_t io_read(void *buf, size_t len, FILE *fp)
 {
-    //printf("Mode: Encrypt\nInput: %s\nOutput: %s\n", in_path, out_path);
+    uint64_t t0 = stats_now();
+    size_t n = fread(buf, 1, len, fp);
+    stats_time(ST_READ_NS, t0);
+    stats_add(ST_READ_BYTES, n);
+    return n;
+}
+
+static size_t io_write(const void *buf, size_t len, FILE *fp)
+{
+    uint64_t t0 = stats_now();
+    size_t n = fwrite(buf, 1, len, fp);
+    stats_time(ST_WRITE_NS, t0);
+    stats_add(ST_WRITE_BYTES, n);
+    return n;
+}
+
 
-    FILE *fp = fopen(in_path, "rb");
-    if (!fp) { perror(in_path); return 1; }
-
-    fseek(fp, 0, SEEK_END);
-    long sz = ftell(fp);
-    if (sz < 0) { perror("ftell"); fclose(fp); return 1; }
-    rewind(fp);
-
-    unsigned char *plain = NULL;
-    if (sz > 0) {
-        plain = malloc(sz);
-        if (!plain) { perror("malloc plain"); fclose(fp); return 1;}
-        if (fread(plain, 1, sz, fp) != (size_t)sz) {
-             fprintf(stderr, "Error reading input file\n");
-             free(plain); fclose(fp); return 1;
+typedef struct {
+    FILE         *in;
+    FILE         *out;
+    Format        format;
+    size_t        block_size;
+    size_t        mod_bytes;
+    size_t        pos;          // input offset of the next block
+    uint64_t      end;          // input offset to stop at (--shards)
+    const RSAKey *pub;
+    BlockMemo    *memo;         // --memo, NULL when off
+    const CtHeader *hdr;
+    CtTrailer     trailer;      // filled in by emit, binary format only
+
+    // --mmap: blocks are read from and written to the mappings directly.
+    const unsigned char *in_map;
+    size_t               in_size;
+    unsigned char       *out_map;
+
+    // --compress: blocks are cut from the LZ frame stream of the input.
+    unsigned char *lz_raw;        // LZ_FRAME_SIZE bytes of input
+    unsigned char *lz_frame;      // the frame being handed out
+    size_t         lz_len;
+    size_t         lz_pos;
+} EncJob;
+
+// Fills buf from the input's LZ frames; short only at the end of input.
+static size_t enc_read_lz(EncJob *job, unsigned char *buf, size_t want)
+{
+    size_t got = 0;
+    while (got < want) {
+        if (job->lz_pos == job->lz_len) {
+            size_t n = io_read(job->lz_raw, LZ_FRAME_SIZE, job->in);
+            if (n == 0) break;
+            job->lz_len = lz_frame_encode(job->lz_raw, n, job->lz_frame);
+            job->lz_pos = 0;
         }
+        size_t take = job->lz_len - job->lz_pos;
+        if (take > want - got) take = want - got;
+        memcpy(buf + got, job->lz_frame + job->lz_pos, take);
+        job->lz_pos += take;
+        got += take;
+    }
+    return got;
+}
+
+typedef struct {
+    size_t               pos;
+    size_t               len;
+    BigInt              *c;
+    const unsigned char *plain;   // len bytes of plaintext (data[] or the input map)
+    unsigned char       *cipher;  // mod_bytes of output (slot or the output map)
+    unsigned char        data[];  // block_size + mod_bytes bytes of scratch
+} EncSlot;
+
+static int enc_load(void *ctx, size_t idx, void *slot)
+{
+    EncJob *job = ctx;
+    EncSlot *s = slot;
+
+    if (job->in_map || job->out_map) {
+        if (job->pos >= job->in_size) return 0;
+        s->len    = (job->in_size - job->pos < job->block_size) ? job->in_size - job->pos : job->block_size;
+        s->plain  = job->in_map + job->pos;
+        s->cipher = job->out_map + ct_block_offset(job->hdr, idx);
     } else {
-         sz = 0;
+        size_t want = job->block_size;
+        if (job->end - job->pos < want) want = (size_t)(job->end - job->pos);
+        if (want == 0) return 0;
+        s->len = job->lz_frame ? enc_read_lz(job, s->data, want) : io_read(s->data, want, job->in);
+        if (s->len < want && ferror(job->in)) {
+            fprintf(stderr, "Error reading input file\n");
+            return -1;
+        }
+        if (s->len == 0) return 0;
+        s->plain  = s->data;
+        s->cipher = s->data + job->block_size;
     }
-    fclose(fp);
+    s->pos = job->pos;
+    s->c = NULL;
+    job->pos += s->len;
+    return 1;
+}
 
-    RSAKey pub = {0}, priv = {0};
-    rsa_generate_keypair(&pub, &priv, 64); // 64 is unused now
-    if (!rsa_save_key("public.key",  &pub,  "PUBLIC")) {
-        fprintf(stderr, "Error saving public key.\n");
-        if (plain) free(plain);
-        rsa_free_key(&pub); rsa_free_key(&priv); return 1;
+static int enc_compute(void *ctx, size_t idx, void *slot)
+{
+    EncJob *job = ctx;
+    EncSlot *s = slot;
+    (void)idx;
+
+    BigInt *m = bytes_to_bigint(s->plain, s->len);
+    if (!m) {
+        fprintf(stderr, "Error converting bytes to BigInt for block at pos %zu.\n", s->pos);
+        return job->format == FMT_BIN ? -1 : 0;   // as below: no skipping in fixed-width output
     }
-    if (!rsa_save_key("private.key", &priv, "PRIVATE")) {
-        fprintf(stderr, "Error saving private key.\n");
-         if (plain) free(plain);
-         rsa_free_key(&pub); rsa_free_key(&priv); return 1;
+
+    s->c = job->memo ? memo_get(job->memo, m) : NULL;
+    if (!s->c) {
+        rsa_encrypt(m, job->pub, &s->c);
+        if (s->c && job->memo) memo_put(job->memo, m, s->c);
+    }
+    bi_free(m);
+    if (!s->c) {
+        fprintf(stderr, "Error during RSA encryption for block at pos %zu.\n", s->pos);
+        // Fixed-width output has no way to skip a block.
+        return job->format == FMT_BIN ? -1 : 0;
+    }
+    if (job->format == FMT_BIN) {
+        bool ok = bi_to_bytes_be(s->c, s->cipher, job->mod_bytes);
+        bi_free(s->c); s->c = NULL;
+        if (!ok) {
+            fprintf(stderr, "Internal error: ciphertext wider than modulus (block at pos %zu).\n", s->pos);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int enc_emit(void *ctx, size_t idx, void *slot)
+{
+    EncJob *job = ctx;
+    EncSlot *s = slot;
+    (void)idx;
+
+    if (job->format == FMT_BIN) {
+        if (!job->out_map && io_write(s->cipher, job->mod_bytes, job->out) != job->mod_bytes) {
+            fprintf(stderr, "Error writing ciphertext to file.\n");
+            return -1;
+        }
+        job->trailer.nblocks++;
+        job->trailer.last_len = (uint32_t)s->len;
+        return 0;
+    }
+
+    if (!s->c) return 0; // block was skipped, already reported
+
+    /* store "length  HEXCIPHERTEXT" per line */
+    uint64_t t0 = stats_now();
+    fprintf(job->out, "%zu ", s->len);
+    bool ok = bi_write_hex(job->out, s->c);
+    stats_time(ST_WRITE_NS, t0);
+    bi_free(s->c); s->c = NULL;
+    if (!ok) {
+        fprintf(stderr, "Error writing ciphertext to file.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void enc_discard(void *ctx, void *slot)
+{
+    (void)ctx;
+    EncSlot *s = slot;
+    bi_free(s->c); s->c = NULL;
+}
+
+
+static int encrypt_file(const char *in_path, const char *out_path, const Options *opt)
+{
+    //printf("Mode: Encrypt\nInput: %s\nOutput: %s\n", in_path, out_path);
+
+    if (opt->has_range) {
+        fprintf(stderr, "Error: --range only applies to 'dec'.\n");
+        return 1;
+    }
+    if (opt->use_mmap && opt->format != FMT_BIN) {
+        fprintf(stderr, "Error: --mmap needs the binary container format.\n");
+        return 1;
+    }
+    if (opt->hybrid && (opt->use_mmap || opt->format != FMT_BIN)) {
+        fprintf(stderr, "Error: --hybrid writes its own format and cannot be combined with --mmap or --format.\n");
+        return 1;
+    }
+    if (opt->memo && opt->hybrid) {
+        fprintf(stderr, "Error: --hybrid has no RSA blocks to reuse; drop --memo.\n");
+        return 1;
+    }
+    if (opt->compress && (opt->use_mmap || opt->hybrid || opt->shards || opt->format != FMT_BIN)) {
+        fprintf(stderr, "Error: --compress needs the binary container and cannot be combined with --mmap, --hybrid or --shards.\n");
+        return 1;
+    }
+
+    FILE *fp = NULL;
+    IoMap in_map = { NULL, 0, -1 }, out_map = { NULL, 0, -1 };
+    if (opt->use_mmap) {
+        if (!iomap_open_read(&in_map, in_path)) return 1;
+    } else {
+        fp = fopen(in_path, "rb");
+        if (!fp) { perror(in_path); return 1; }
+        setvbuf(fp, NULL, _IOFBF, IO_BUFFER_SIZE);
+    }
+
+    RSAKey pub = {0}, priv = {0};
+    int rc = -1;
+    FILE *fc = NULL;
+    if (opt->shards) {
+        // Shards run as separate processes and must share one key. It has to
+        // exist before they start: shards that generated it themselves would
+        // race, one rewriting the key while another loads it.
+        if (!rsa_load_key("public.key", &pub)) {
+            fprintf(stderr, "Error: --shards encrypts with an existing public.key; create it first with a plain 'enc' run.\n");
+            goto enc_done;
+        }
+    } else {
+        rsa_generate_keypair(&pub, &priv, 64); // 64 is unused now
+        if (!rsa_save_key("public.key",  &pub,  "PUBLIC")) {
+            fprintf(stderr, "Error saving public key.\n");
+            goto enc_done;
+        }
+        if (!rsa_save_key("private.key", &priv, "PRIVATE")) {
+            fprintf(stderr, "Error saving private key.\n");
+            goto enc_done;
+        }
     }
 
     if (!pub.n) {
         fprintf(stderr, "Error: Public key modulus not generated.\n");
-         if (plain) free(plain);
-         rsa_free_key(&pub); rsa_free_key(&priv); return 1;
+        goto enc_done;
     }
      size_t n_bitlen = bi_bitlen(pub.n);
      if (n_bitlen <= 8) {
          fprintf(stderr, "Error: Key modulus n is too small (%zu bits).\n", n_bitlen);
-         if (plain) free(plain);
-         rsa_free_key(&pub); rsa_free_key(&priv); return 1;
+         goto enc_done;
      }
     size_t block_size = (n_bitlen - 1) / 8;
 
-    FILE *fc = fopen(out_path, "w");
-    if (!fc) {
-        perror(out_path);
-        if (plain) free(plain);
-        rsa_free_key(&pub); rsa_free_key(&priv); return 1;
+    if (opt->hybrid) {
+        fc = fopen(out_path, "wb");
+        if (!fc) { perror(out_path); goto enc_done; }
+        setvbuf(fc, NULL, _IOFBF, IO_BUFFER_SIZE);
+        rc = hybrid_encrypt_stream(fp, fc, &pub);
+        goto enc_done;
     }
 
-    for (size_t pos = 0; pos < (size_t)sz; pos += block_size) {
-        size_t chunk_len = (pos + block_size <= (size_t)sz)
-                           ? block_size
-                           : (size_t)sz - pos;
-
-        if (chunk_len == 0) continue;
+    CtHeader hdr;
+    ct_header_init(&hdr, pub.n);
+    if (opt->compress) hdr.flags |= CT_FLAG_LZ;
+    unsigned char raw_hdr[CT_PART_HEADER_SIZE];
+    size_t hdr_len = CT_HEADER_SIZE;
+    ct_encode_header(raw_hdr, &hdr);
 
-        BigInt *m = bytes_to_bigint(plain + pos, chunk_len);
-        if (!m) { fprintf(stderr, "Error converting bytes to BigInt for block at pos %zu.\n", pos); continue; }
+    CtPart part = { hdr };
+    uint64_t start = 0, end = UINT64_MAX;
+    if (opt->shards) {
+        // Block boundaries come from the input size, which must be known
+        // up front; the shard's range is then read from its offset.
+        struct stat st;
+        if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Error: --shards needs a regular input file.\n");
+            goto enc_done;
+        }
+        uint64_t size = (uint64_t)st.st_size;
+        part.kind           = CT_PART_CIPHER;
+        part.shards         = opt->shards;
+        part.shard          = opt->shard;
+        part.whole.nblocks  = (size + block_size - 1) / block_size;
+        part.whole.last_len = part.whole.nblocks ? (uint32_t)(size - (part.whole.nblocks - 1) * block_size) : 0;
+        uint64_t hi;
+        ct_shard_range(part.whole.nblocks, part.shards, part.shard, &part.first_block, &hi);
+        part.nblocks = hi - part.first_block;
+        start = part.first_block * block_size;
+        end   = hi * block_size < size ? hi * block_size : size;
+        if (fseeko(fp, (off_t)start, SEEK_SET) != 0) { perror(in_path); goto enc_done; }
+        ct_encode_part(raw_hdr, &part);
+        hdr_len = CT_PART_HEADER_SIZE;
+    }
 
-        BigInt *c = NULL;
-        rsa_encrypt(m, &pub, &c);
-        if (!c) { fprintf(stderr, "Error during RSA encryption for block at pos %zu.\n", pos); bi_free(m); continue; }
+    if (opt->use_mmap) {
+        // Fixed-width blocks: the container size is known before any work.
+        uint64_t nblocks = (in_map.size + block_size - 1) / block_size;
+        if (!iomap_create(&out_map, out_path, ct_block_offset(&hdr, nblocks) + CT_TRAILER_SIZE)) goto enc_done;
+        memcpy(out_map.data, raw_hdr, CT_HEADER_SIZE);
+    } else {
+        fc = fopen(out_path, opt->format == FMT_BIN ? "wb" : "w");
+        if (!fc) { perror(out_path); goto enc_done; }
+        setvbuf(fc, NULL, _IOFBF, IO_BUFFER_SIZE);
+        if (opt->format == FMT_BIN && fwrite(raw_hdr, 1, hdr_len, fc) != hdr_len) {
+            fprintf(stderr, "Error writing ciphertext to file.\n");
+            goto enc_done;
+        }
+    }
 
-        /* store "length  HEXCIPHERTEXT" per line */
-        fprintf(fc, "%zu ", chunk_len);
-        if (!bi_write_hex(fc, c)) {
-             fprintf(stderr, "Error writing ciphertext to file.\n");
-             bi_free(m); bi_free(c); fclose(fc);
-             if (plain) free(plain);
-             rsa_free_key(&pub); rsa_free_key(&priv); return 1;
+    EncJob job = {
+        .in = fp, .out = fc, .format = opt->format,
+        .block_size = block_size, .mod_bytes = hdr.mod_bytes,
+        .pos = (size_t)start, .end = end,
+        .pub = &pub, .hdr = &hdr,
+        .in_map = in_map.data, .in_size = in_map.size, .out_map = out_map.data,
+    };
+    if (opt->memo && !(job.memo = memo_create(opt->memo, pub.n->len))) {
+        perror("malloc block memo");
+        goto enc_done;
+    }
+    if (opt->compress) {
+        job.lz_raw   = malloc(LZ_FRAME_SIZE);
+        job.lz_frame = malloc(LZ_FRAME_MAX);
+        if (!job.lz_raw || !job.lz_frame) {
+            perror("malloc compression buffers");
+            free(job.lz_raw); free(job.lz_frame); memo_free(job.memo);
+            goto enc_done;
         }
+    }
+    PoolJob pj = {
+        .nthreads  = opt->nthreads,
+        .window    = opt->nthreads * BLOCKS_PER_THREAD,
+        .slot_size = sizeof(EncSlot) + block_size + hdr.mod_bytes,
+        .ctx       = &job,
+        .load      = enc_load,
+        .compute   = enc_compute,
+        .emit      = enc_emit,
+        .discard   = enc_discard,
+    };
+    rc = pool_run_ordered(&pj);
+    free(job.lz_raw);
+    free(job.lz_frame);
+    memo_free(job.memo);
 
-        bi_free(m);
-        bi_free(c);
+    if (rc == 0 && opt->shards) {
+        if (job.trailer.nblocks != part.nblocks) {
+            fprintf(stderr, "Error: Input changed size while encrypting shard %u.\n", opt->shard);
+            rc = -1;
+        }
+    } else if (rc == 0 && opt->format == FMT_BIN) {
+        unsigned char raw_tr[CT_TRAILER_SIZE];
+        ct_encode_trailer(raw_tr, &job.trailer);
+        if (out_map.data) {
+            memcpy(out_map.data + ct_block_offset(&hdr, job.trailer.nblocks), raw_tr, sizeof raw_tr);
+        } else if (fwrite(raw_tr, 1, sizeof raw_tr, fc) != sizeof raw_tr) {
+            fprintf(stderr, "Error writing ciphertext to file.\n");
+            rc = -1;
+        }
     }
-    fclose(fc);
 
+enc_done:
+    if (fc && fclose(fc) != 0) { perror(out_path); rc = -1; }
+    if (out_map.fd >= 0 && !iomap_close(&out_map)) rc = -1;
+    if (fp) fclose(fp);
+    if (in_map.fd >= 0) iomap_close(&in_map);
 
-    if (plain) free(plain);
     rsa_free_key(&pub);
     rsa_free_key(&priv);
 
     //puts("OK - Encryption complete!"); 
-    return 0;
+    return rc == 0 ? 0 : 1;
 }
 
 
-static int decrypt_file(const char *in_path, const char *out_path)
-{
+typedef struct {
+    FILE          *in;
+    FILE          *out;
+    const RSAKey  *priv;
+    BlockMemo     *memo;          // --memo, NULL when off
+    size_t         max_block_size;
+    size_t         block_num;     // 1-based block counter, for messages
 
-    RSAKey priv = {0};
-    if (!rsa_load_key("private.key", &priv)) {
-        fprintf(stderr, "Error loading private key from 'private.key'.\n");
-        fprintf(stderr, "Ensure 'private.key' exists (generate via 'enc' mode first).\n");
-        return 1;
-    }
-     if (!priv.n) {
-        fprintf(stderr, "Error: Private key missing modulus n.\n");
-        rsa_free_key(&priv); return 1;
-     }
-    size_t n_bitlen = bi_bitlen(priv.n);
-     if (n_bitlen <= 8) {
-         fprintf(stderr, "Error: Key modulus n is too small (%zu bits).\n", n_bitlen);
-         rsa_free_key(&priv); return 1;
-     }
-    size_t max_block_size = (n_bitlen - 1) / 8;
+    // Binary container only: blocks [next_block, end_block) are decrypted
+    // and plaintext bytes [range_lo, range_hi) of them are written.
+    const CtHeader  *hdr;
+    const CtTrailer *trailer;
+    uint64_t         next_block;
+    uint64_t         end_block;
+    uint64_t         range_lo;
+    uint64_t         range_hi;
+    unsigned char   *raw;         // one ciphertext block
 
+    // --mmap: ciphertext is read from in_map and plaintext bytes
+    // [range_lo, range_hi) are written to out_map at offset 0.
+    const unsigned char *in_map;
+    unsigned char       *out_map;
 
-    FILE *fc = fopen(in_path, "r");
-    if (!fc) { perror(in_path); rsa_free_key(&priv); return 1; }
+    // Compressed container: plaintext goes through the frame decoder.
+    LzDecoder           *lz;
+} DecJob;
+
+typedef struct {
+    size_t         block_num;
+    size_t         chunk_len;
+    size_t         skip;          // bytes of data[] to drop before writing
+    size_t         take;          // bytes of data[] to write
+    size_t         out_off;       // --mmap: offset of the first written byte in out_map
+    unsigned char *dst;           // where the whole block is decrypted to (NULL = data[])
+    BigInt        *c;
+    unsigned char  data[];        // chunk_len bytes of recovered plaintext
+} DecSlot;
 
-    // Dynamic buffer for recovered plaintext
-    size_t recovered_capacity = 1024;
-    unsigned char *recovered = malloc(recovered_capacity);
-    if (!recovered) { perror("malloc recovered"); fclose(fc); rsa_free_key(&priv); return 1; }
-    size_t written = 0;
+static int dec_read_hex(void *ctx, size_t idx, void *slot)
+{
+    DecJob *job = ctx;
+    DecSlot *s = slot;
+    FILE *fc = job->in;
+    (void)idx;
 
-    size_t block_num = 0;
-    while (true) { // Loop until break
-        block_num++;
+    while (true) { // Loop until a block is read or the input ends
+        size_t block_num = ++job->block_num;
         size_t chunk_len;
         int scan_result = fscanf(fc, "%zu ", &chunk_len);
 
-        if (scan_result == EOF) { break; }
+        if (scan_result == EOF) { return 0; }
         if (scan_result != 1) {
              int c = fgetc(fc);
              while (isspace(c)) c = fgetc(fc);
-             if (c == EOF) break;
+             if (c == EOF) return 0;
             fprintf(stderr, "Error reading chunk length from ciphertext file (block %zu).\n", block_num);
-            free(recovered); fclose(fc); rsa_free_key(&priv); return 1;
+            return -1;
         }
-        if (chunk_len == 0 || chunk_len > max_block_size ) {
+        if (chunk_len == 0 || chunk_len > job->max_block_size ) {
              fprintf(stderr, "Warning: Suspicious chunk length %zu read from ciphertext file (block %zu, max expected %zu).\n",
-                     chunk_len, block_num, max_block_size);
+                     chunk_len, block_num, job->max_block_size);
              char *line = NULL; size_t cap = 0; getline(&line, &cap, fc); free(line);
              continue;
         }
@@ -241,96 +696,405 @@ static int decrypt_file(const char *in_path, const char *out_path)
         if (!c) {
              if (feof(fc)) {
                   fprintf(stderr, "Warning: Incomplete last line in ciphertext file (block %zu).\n", block_num);
-                  break;
+                  return 0;
              }
              fprintf(stderr, "Error reading ciphertext hex from file (block %zu).\n", block_num);
-             free(recovered); fclose(fc); rsa_free_key(&priv); return 1;
+             return -1;
         }
 
-        BigInt *m = NULL;
-        rsa_decrypt(c, &priv, &m);
-         if (!m) {
-              fprintf(stderr, "Error during RSA decryption (block %zu).\n", block_num);
-              bi_free(c); free(recovered); fclose(fc); rsa_free_key(&priv); return 1;
-         }
+        s->block_num = block_num;
+        s->chunk_len = chunk_len;
+        s->skip      = 0;
+        s->take      = chunk_len;
+        s->dst       = NULL;
+        s->c         = c;
+        return 1;
+    }
+}
 
-        unsigned char *chunk = NULL;
-        size_t clen = 0;
-        bigint_to_bytes(m, &chunk, &clen);
-        if (!chunk && clen > 0) {
-             fprintf(stderr, "Error converting decrypted BigInt to bytes (block %zu).\n", block_num);
-             bi_free(m); bi_free(c); free(recovered); fclose(fc); rsa_free_key(&priv); return 1;
-         }
-         if (!chunk && clen == 0 && !(m->len == 1 && m->limbs[0] == 0)) {
-              fprintf(stderr, "Internal Error: bigint_to_bytes inconsistency (block %zu).\n", block_num);
-              bi_free(m); bi_free(c); free(recovered); fclose(fc); rsa_free_key(&priv); return 1;
-         }
+// Hex lines are parsed as they are read, so the whole load counts as I/O.
+static int dec_load_hex(void *ctx, size_t idx, void *slot)
+{
+    uint64_t t0 = stats_now();
+    int rc = dec_read_hex(ctx, idx, slot);
+    stats_time(ST_READ_NS, t0);
+    return rc;
+}
 
-        size_t pad = 0;
-        if (chunk_len > clen) {
-            pad = chunk_len - clen;
-        }
+static int dec_load_bin(void *ctx, size_t idx, void *slot)
+{
+    DecJob *job = ctx;
+    DecSlot *s = slot;
+    (void)idx;
 
-        if (written + chunk_len > recovered_capacity) {
-             size_t new_capacity = recovered_capacity * 2;
-             if (new_capacity < written + chunk_len) {
-                 new_capacity = written + chunk_len + 1024;
-             }
-             unsigned char *new_recovered = realloc(recovered, new_capacity);
-             if (!new_recovered) {
-                 perror("realloc recovered buffer");
-                 free(recovered); free(chunk); bi_free(m); bi_free(c); fclose(fc); rsa_free_key(&priv); return 1;
-             }
-             recovered = new_recovered;
-             recovered_capacity = new_capacity;
-        }
+    if (job->next_block >= job->end_block) return 0;
+    uint64_t blk = job->next_block++;
 
-        if (pad > 0) {
-            memset(recovered + written, 0, pad);
-        }
+    const unsigned char *raw = job->raw;
+    if (job->in_map) {
+        raw = job->in_map + ct_block_offset(job->hdr, blk);
+    } else if (io_read(job->raw, job->hdr->mod_bytes, job->in) != job->hdr->mod_bytes) {
+        fprintf(stderr, "Error reading ciphertext block %llu.\n", (unsigned long long)blk + 1);
+        return -1;
+    }
+    s->c = bytes_to_bigint(raw, job->hdr->mod_bytes);
+    if (!s->c) return -1;
+
+    uint64_t lo = blk * job->hdr->block_size;
+    s->block_num = (size_t)blk + 1;
+    s->chunk_len = ct_block_len(job->hdr, job->trailer, blk);
+    s->skip      = (job->range_lo > lo) ? (size_t)(job->range_lo - lo) : 0;
+    s->take      = ((job->range_hi < lo + s->chunk_len) ? (size_t)(job->range_hi - lo) : s->chunk_len) - s->skip;
+    s->out_off   = (size_t)(lo + s->skip - job->range_lo);
+    // Blocks wholly inside the range are decrypted straight into the output.
+    s->dst       = (job->out_map && s->take == s->chunk_len) ? job->out_map + s->out_off : NULL;
+    return 1;
+}
+
+// Decrypts one block into s->data, left-padded with zeros to the
+// original chunk length recorded next to the ciphertext.
+static int dec_compute(void *ctx, size_t idx, void *slot)
+{
+    DecJob *job = ctx;
+    DecSlot *s = slot;
+    size_t chunk_len = s->chunk_len;
+    (void)idx;
 
-        size_t bytes_to_copy = clen;
-        if (clen > chunk_len) {
-             fprintf(stderr, "Warning: Decrypted data length %zu > original chunk length %zu (block %zu). Truncating.\n",
-                     clen, chunk_len, block_num);
-             bytes_to_copy = chunk_len;
-             pad = 0;
+    BigInt *m = job->memo ? memo_get(job->memo, s->c) : NULL;
+    if (!m) {
+        rsa_decrypt(s->c, job->priv, &m);
+        if (m && job->memo) memo_put(job->memo, s->c, m);
+    }
+    bi_free(s->c); s->c = NULL;
+     if (!m) {
+          fprintf(stderr, "Error during RSA decryption (block %zu).\n", s->block_num);
+          return -1;
+     }
+
+    if (job->hdr) {
+        // Fixed-width container blocks: write the zero-padded plaintext
+        // straight to its destination.
+        bool ok = bi_to_bytes_be(m, s->dst ? s->dst : s->data, chunk_len);
+        bi_free(m);
+        if (!ok) {
+            fprintf(stderr, "Error: Decrypted block %zu is longer than its recorded length %zu.\n",
+                    s->block_num, chunk_len);
+            return -1;
         }
+        return 0;
+    }
 
-        if (bytes_to_copy > 0) {
-            if (chunk) {
-                memcpy(recovered + written + pad, chunk, bytes_to_copy);
-            } else {
-                 fprintf(stderr, "Internal error during data copy in decryption (block %zu).\n", block_num);
-                 free(recovered); free(chunk); bi_free(m); bi_free(c); fclose(fc); rsa_free_key(&priv); return 1;
-            }
+    unsigned char *chunk = NULL;
+    size_t clen = 0;
+    bigint_to_bytes(m, &chunk, &clen);
+    if (!chunk && clen > 0) {
+         fprintf(stderr, "Error converting decrypted BigInt to bytes (block %zu).\n", s->block_num);
+         bi_free(m); return -1;
+     }
+     if (!chunk && clen == 0 && !(m->len == 1 && m->limbs[0] == 0)) {
+          fprintf(stderr, "Internal Error: bigint_to_bytes inconsistency (block %zu).\n", s->block_num);
+          bi_free(m); return -1;
+     }
+    bi_free(m);
+
+    size_t pad = 0;
+    if (chunk_len > clen) {
+        pad = chunk_len - clen;
+    }
+    if (pad > 0) {
+        memset(s->data, 0, pad);
+    }
+
+    size_t bytes_to_copy = clen;
+    if (clen > chunk_len) {
+         fprintf(stderr, "Warning: Decrypted data length %zu > original chunk length %zu (block %zu). Truncating.\n",
+                 clen, chunk_len, s->block_num);
+         bytes_to_copy = chunk_len;
+         pad = 0;
+    }
+
+    if (bytes_to_copy > 0) {
+        if (chunk) {
+            memcpy(s->data + pad, chunk, bytes_to_copy);
+        } else {
+             fprintf(stderr, "Internal error during data copy in decryption (block %zu).\n", s->block_num);
+             return -1;
         }
+    }
 
-        written += chunk_len;
+    free(chunk);
+    return 0;
+}
 
-        free(chunk);
-        bi_free(m);
-        bi_free(c);
-    } 
+static int dec_emit(void *ctx, size_t idx, void *slot)
+{
+    DecJob *job = ctx;
+    DecSlot *s = slot;
+    (void)idx;
 
-    fclose(fc);
+    if (s->dst) return 0;
+    if (job->lz) return lz_decoder_put(job->lz, s->data + s->skip, s->take) == 0 ? 0 : -1;
+    if (job->out_map) {
+        memcpy(job->out_map + s->out_off, s->data + s->skip, s->take);
+        return 0;
+    }
+    if (io_write(s->data + s->skip, s->take, job->out) != s->take) {
+         fprintf(stderr, "Error writing recovered plaintext to output file.\n");
+         return -1;
+    }
+    return 0;
+}
+
+// Receives the decompressed frames of a --compress container.
+static int dec_sink(void *ctx, const unsigned char *p, size_t n)
+{
+    if (io_write(p, n, ctx) != n) {
+        fprintf(stderr, "Error writing recovered plaintext to output file.\n");
+        return -1;
+    }
+    return 0;
+}
 
+static void dec_discard(void *ctx, void *slot)
+{
+    (void)ctx;
+    DecSlot *s = slot;
+    bi_free(s->c); s->c = NULL;
+}
+
+// Drops a partially written plaintext. Only regular files are removed:
+// the output may just as well be a pipe or a device such as /dev/stdout.
+static void remove_partial(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) remove(path);
+}
+
+// Checks a decoded header/trailer against the key and selects the blocks
+// that cover the requested plaintext range.
+static bool dec_setup_bin(DecJob *job, const unsigned char *raw_hdr, const unsigned char *raw_tr,
+                          uint64_t file_size, CtHeader *hdr, CtTrailer *tr, const Options *opt)
+{
+    if (!ct_decode_header(raw_hdr, hdr)) {
+        fprintf(stderr, "Error: Invalid ciphertext container header.\n");
+        return false;
+    }
+    if (!raw_tr || !ct_decode_trailer(raw_tr, tr)) {
+        fprintf(stderr, "Error: Missing or invalid ciphertext container trailer.\n");
+        return false;
+    }
+    if (!ct_validate(hdr, tr, job->priv->n, file_size)) return false;
+    if ((hdr->flags & CT_FLAG_LZ) && (opt->has_range || opt->shards || opt->use_mmap)) {
+        // Offsets inside the compressed stream mean nothing to the caller
+        fprintf(stderr, "Error: A --compress container can only be decrypted whole, without --range, --shards or --mmap.\n");
+        return false;
+    }
+
+    uint64_t plain = ct_plain_size(hdr, tr);
+    uint64_t lo = opt->has_range ? opt->range_off : 0;
+    uint64_t hi = plain;
+    if (lo > plain) lo = plain;
+    if (opt->has_range && opt->range_len < plain - lo) hi = lo + opt->range_len;
+    if (opt->shards) {
+        uint64_t blo, bhi;
+        ct_shard_range(tr->nblocks, opt->shards, opt->shard, &blo, &bhi);
+        lo = blo * hdr->block_size;
+        hi = (bhi * hdr->block_size < plain) ? bhi * hdr->block_size : plain;
+    }
+
+    job->hdr        = hdr;
+    job->trailer    = tr;
+    job->range_lo   = lo;
+    job->range_hi   = hi;
+    job->next_block = lo / hdr->block_size;
+    job->end_block  = (hi > lo) ? (hi + hdr->block_size - 1) / hdr->block_size : job->next_block;
+    return true;
+}
+
+// Reads the container header and trailer through stdio, then positions
+// the stream on the first block of the requested plaintext range.
+static bool dec_open_bin(DecJob *job, CtHeader *hdr, CtTrailer *tr, const Options *opt)
+{
+    FILE *fc = job->in;
+    unsigned char raw_hdr[CT_HEADER_SIZE], raw_tr[CT_TRAILER_SIZE];
+
+    if (fread(raw_hdr, 1, sizeof raw_hdr, fc) != sizeof raw_hdr) {
+        fprintf(stderr, "Error: Invalid ciphertext container header.\n");
+        return false;
+    }
+    if (fseeko(fc, 0, SEEK_END) != 0) {
+        fprintf(stderr, "Error: Binary ciphertext input must be seekable.\n");
+        return false;
+    }
+    off_t file_size = ftello(fc);
+    bool have_tr = file_size >= CT_HEADER_SIZE + CT_TRAILER_SIZE &&
+                   fseeko(fc, file_size - CT_TRAILER_SIZE, SEEK_SET) == 0 &&
+                   fread(raw_tr, 1, sizeof raw_tr, fc) == sizeof raw_tr;
+    if (!dec_setup_bin(job, raw_hdr, have_tr ? raw_tr : NULL, (uint64_t)file_size, hdr, tr, opt)) return false;
+
+    if (fseeko(fc, (off_t)ct_block_offset(hdr, job->next_block), SEEK_SET) != 0) {
+        perror("fseeko");
+        return false;
+    }
+    return true;
+}
+
+static int run_decrypt_pool(DecJob *job, const Options *opt, bool binary, size_t max_block_size)
+{
+    PoolJob pj = {
+        .nthreads  = opt->nthreads,
+        .window    = opt->nthreads * BLOCKS_PER_THREAD,
+        .slot_size = sizeof(DecSlot) + max_block_size,
+        .ctx       = job,
+        .load      = binary ? dec_load_bin : dec_load_hex,
+        .compute   = dec_compute,
+        .emit      = dec_emit,
+        .discard   = dec_discard,
+    };
+    if (opt->memo && !(job->memo = memo_create(opt->memo, job->priv->n->len))) {
+        perror("malloc block memo");
+        return -1;
+    }
+    int rc = pool_run_ordered(&pj);
+    memo_free(job->memo);
+    job->memo = NULL;
+    return rc;
+}
+
+// --mmap decryption: both files are mapped and every block wholly inside
+// the range is decrypted directly into its final place in the output.
+static int decrypt_mapped(DecJob *job, const char *in_path, const char *out_path,
+                          const Options *opt, size_t max_block_size)
+{
+    IoMap in_map, out_map = { NULL, 0, -1 };
+    CtHeader hdr;
+    CtTrailer tr;
+    int rc = -1;
+
+    if (!iomap_open_read(&in_map, in_path)) return -1;
+    if (in_map.size < CT_HEADER_SIZE + CT_TRAILER_SIZE || in_map.data[0] != CT_MAGIC[0]) {
+        fprintf(stderr, "Error: --mmap needs the binary container format.\n");
+        goto mapped_done;
+    }
+    if (!dec_setup_bin(job, in_map.data, in_map.data + in_map.size - CT_TRAILER_SIZE,
+                       in_map.size, &hdr, &tr, opt)) goto mapped_done;
+    if (!iomap_create(&out_map, out_path, (size_t)(job->range_hi - job->range_lo))) goto mapped_done;
+
+    job->in_map  = in_map.data;
+    job->out_map = out_map.data;
+    rc = run_decrypt_pool(job, opt, true, max_block_size);
+
+mapped_done:
+    if (out_map.fd >= 0) {
+        if (!iomap_close(&out_map)) rc = -1;
+        if (rc != 0) remove_partial(out_path);
+    }
+    iomap_close(&in_map);
+    return rc;
+}
+
+
+static int decrypt_file(const char *in_path, const char *out_path, const Options *opt)
+{
+
+    RSAKey priv = {0};
+    if (!rsa_load_key("private.key", &priv)) {
+        fprintf(stderr, "Error loading private key from 'private.key'.\n");
+        fprintf(stderr, "Ensure 'private.key' exists (generate via 'enc' mode first).\n");
+        return 1;
+    }
+     if (!priv.n) {
+        fprintf(stderr, "Error: Private key missing modulus n.\n");
+        rsa_free_key(&priv); return 1;
+     }
+    size_t n_bitlen = bi_bitlen(priv.n);
+     if (n_bitlen <= 8) {
+         fprintf(stderr, "Error: Key modulus n is too small (%zu bits).\n", n_bitlen);
+         rsa_free_key(&priv); return 1;
+     }
+    size_t max_block_size = (n_bitlen - 1) / 8;
+
+
+    DecJob job = { NULL, NULL, &priv, NULL, max_block_size, 0 };
+    int rc;
+    if (opt->use_mmap) {
+        rc = decrypt_mapped(&job, in_path, out_path, opt, max_block_size);
+        rsa_free_key(&priv);
+        return rc == 0 ? 0 : 1;
+    }
+
+    FILE *fc = fopen(in_path, "rb");
+    if (!fc) { perror(in_path); rsa_free_key(&priv); return 1; }
+    setvbuf(fc, NULL, _IOFBF, IO_BUFFER_SIZE);
+    job.in = fc;
+
+    // The binary container starts with 'R', hybrid files with 'H'; hex
+    // lines start with a digit.
+    int first = getc(fc);
+    bool binary = (first == CT_MAGIC[0]);
+    if (first != EOF) ungetc(first, fc);
+    if (first != CT_MAGIC[0] && opt->shards) {
+        fprintf(stderr, "Error: --shards needs the binary container format.\n");
+        fclose(fc); rsa_free_key(&priv); return 1;
+    }
+    if (first == HYB_MAGIC[0]) {
+        FILE *fo = fopen(out_path, "wb");
+        if (!fo) { perror(out_path); fclose(fc); rsa_free_key(&priv); return 1; }
+        setvbuf(fo, NULL, _IOFBF, IO_BUFFER_SIZE);
+        rc = hybrid_decrypt_stream(fc, fo, &priv, opt->has_range ? opt->range_off : 0, opt->range_len);
+        if (fclose(fo) != 0) { perror(out_path); rc = -1; }
+        fclose(fc);
+        if (rc != 0) remove_partial(out_path);
+        rsa_free_key(&priv);
+        return rc == 0 ? 0 : 1;
+    }
+    if (!binary && opt->has_range) {
+        fprintf(stderr, "Error: --range needs the binary container format.\n");
+        fclose(fc); rsa_free_key(&priv); return 1;
+    }
+
+    CtHeader hdr;
+    CtTrailer tr;
+    if (binary) {
+        if (!dec_open_bin(&job, &hdr, &tr, opt)) { fclose(fc); rsa_free_key(&priv); return 1; }
+        job.raw = malloc(hdr.mod_bytes);
+        if (!job.raw) { perror("malloc block"); fclose(fc); rsa_free_key(&priv); return 1; }
+    }
 
     FILE *fo = fopen(out_path, "wb");
-    if (!fo) { perror(out_path); free(recovered); rsa_free_key(&priv); return 1; }
+    if (!fo) { perror(out_path); free(job.raw); fclose(fc); rsa_free_key(&priv); return 1; }
+    setvbuf(fo, NULL, _IOFBF, IO_BUFFER_SIZE);
+    job.out = fo;
 
-    if (recovered && written > 0) {
-        if (fwrite(recovered, 1, written, fo) != written) {
-             fprintf(stderr, "Error writing recovered plaintext to output file.\n");
-             fclose(fo); free(recovered); rsa_free_key(&priv); return 1;
+    rc = 0;
+    if (binary && (hdr.flags & CT_FLAG_LZ)) {
+        job.lz = malloc(sizeof *job.lz);
+        if (!job.lz) { perror("malloc decompression buffers"); rc = -1; }
+        else lz_decoder_init(job.lz, dec_sink, fo);
+    }
+    if (opt->shards) {
+        CtPart part = { hdr, tr, CT_PART_PLAIN, opt->shard, opt->shards,
+                        job.next_block, job.end_block - job.next_block };
+        unsigned char raw_part[CT_PART_HEADER_SIZE];
+        ct_encode_part(raw_part, &part);
+        if (fwrite(raw_part, 1, sizeof raw_part, fo) != sizeof raw_part) {
+            fprintf(stderr, "Error writing recovered plaintext to output file.\n");
+            rc = -1;
         }
     }
 
-    fclose(fo);
+    if (rc == 0) rc = run_decrypt_pool(&job, opt, binary, max_block_size);
+    if (rc == 0 && job.lz) rc = lz_decoder_finish(job.lz);
+    free(job.lz);
+    if (fclose(fo) != 0) { perror(out_path); rc = -1; }
+    fclose(fc);
+    free(job.raw);
 
+    // Output is streamed as blocks complete; do not leave a truncated
+    // plaintext behind when decryption fails part-way.
+    if (rc != 0) remove_partial(out_path);
 
-    free(recovered);
     rsa_free_key(&priv);
 
-    return 0;
+    return rc == 0 ? 0 : 1;
 }
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+#include "memo.h"
+#include "stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMO_WAYS 4
+
+// Followed by 2 * max_limbs limbs: the key, then the value.
+typedef struct {
+    uint64_t hash;
+    uint64_t last_use;        // memo->tick at the last hit or store
+    uint32_t klen;            // 0 = empty
+    uint32_t vlen;
+} MemoEntry;
+
+struct BlockMemo {
+    pthread_mutex_t mu;
+    size_t          nsets;    // power of two
+    size_t          max_limbs;
+    size_t          stride;   // bytes per entry
+    uint64_t        tick;
+    unsigned char  *slab;
+};
+
+// Limbs without the zero limbs on top, so untrimmed inputs still match.
+static size_t sig_limbs(const BigInt *a)
+{
+    size_t n = a->len;
+    while (n > 1 && a->limbs[n - 1] == 0) n--;
+    return n;
+}
+
+static uint64_t hash_limbs(const uint32_t *l, size_t n)
+{
+    uint64_t h = n;
+    for (size_t i = 0; i < n; ++i) h = (h ^ l[i]) * 0x100000001b3ull;
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 29);
+}
+
+static MemoEntry *entry(const BlockMemo *memo, size_t set, size_t way)
+{
+    return (MemoEntry *)(memo->slab + (set * MEMO_WAYS + way) * memo->stride);
+}
+
+static uint32_t *key_of(MemoEntry *e) { return (uint32_t *)(e + 1); }
+
+BlockMemo *memo_create(size_t entries, size_t max_limbs)
+{
+    BlockMemo *memo = calloc(1, sizeof *memo);
+    if (!memo) return NULL;
+    memo->nsets = 1;
+    while (memo->nsets * MEMO_WAYS < entries) memo->nsets <<= 1;
+    memo->max_limbs = max_limbs;
+    memo->stride    = (sizeof(MemoEntry) + 2 * max_limbs * sizeof(uint32_t) + 7) & ~(size_t)7;
+    memo->slab      = calloc(memo->nsets * MEMO_WAYS, memo->stride);
+    if (!memo->slab) {
+        free(memo);
+        return NULL;
+    }
+    pthread_mutex_init(&memo->mu, NULL);
+    return memo;
+}
+
+void memo_free(BlockMemo *memo)
+{
+    if (!memo) return;
+    pthread_mutex_destroy(&memo->mu);
+    free(memo->slab);
+    free(memo);
+}
+
+BigInt *memo_get(BlockMemo *memo, const BigInt *in)
+{
+    size_t klen = sig_limbs(in);
+    if (klen > memo->max_limbs) return NULL;
+    uint64_t h = hash_limbs(in->limbs, klen);
+    size_t set = (size_t)h & (memo->nsets - 1);
+    BigInt *out = NULL;
+
+    pthread_mutex_lock(&memo->mu);
+    for (size_t w = 0; w < MEMO_WAYS; ++w) {
+        MemoEntry *e = entry(memo, set, w);
+        if (e->klen != klen || e->hash != h || memcmp(key_of(e), in->limbs, klen * sizeof(uint32_t)) != 0)
+            continue;
+        e->last_use = ++memo->tick;
+        out = bi_new(e->vlen);
+        if (out) memcpy(out->limbs, key_of(e) + memo->max_limbs, e->vlen * sizeof(uint32_t));
+        break;
+    }
+    pthread_mutex_unlock(&memo->mu);
+    stats_add(out ? ST_MEMO_HITS : ST_MEMO_MISSES, 1);
+    return out;
+}
+
+void memo_put(BlockMemo *memo, const BigInt *in, const BigInt *out)
+{
+    size_t klen = sig_limbs(in), vlen = sig_limbs(out);
+    if (klen > memo->max_limbs || vlen > memo->max_limbs) return;
+    uint64_t h = hash_limbs(in->limbs, klen);
+    size_t set = (size_t)h & (memo->nsets - 1);
+
+    pthread_mutex_lock(&memo->mu);
+    // Another worker may have stored the same block meanwhile; otherwise
+    // take an empty way or the least recently used one.
+    MemoEntry *victim = entry(memo, set, 0);
+    for (size_t w = 0; w < MEMO_WAYS; ++w) {
+        MemoEntry *e = entry(memo, set, w);
+        if (e->klen == klen && e->hash == h && memcmp(key_of(e), in->limbs, klen * sizeof(uint32_t)) == 0) {
+            victim = e;
+            break;
+        }
+        if (e->klen == 0 || (victim->klen != 0 && e->last_use < victim->last_use)) victim = e;
+    }
+    victim->hash     = h;
+    victim->last_use = ++memo->tick;
+    victim->klen     = (uint32_t)klen;
+    victim->vlen     = (uint32_t)vlen;
+    memcpy(key_of(victim), in->limbs, klen * sizeof(uint32_t));
+    memcpy(key_of(victim) + memo->max_limbs, out->limbs, vlen * sizeof(uint32_t));
+    pthread_mutex_unlock(&memo->mu);
+}
@@ -0,0 +1,27 @@
+#ifndef MEMO_H
+#define MEMO_H
+#include "BigInt.h"
+
+/* Bounded cache of block modexp results for `--memo N`.
+ *
+ * Textbook RSA maps equal blocks to equal results, so a file with many
+ * repeated blocks (padded records, runs of zeros) only needs one modexp
+ * per distinct block. Entries are keyed by the input's limbs, found
+ * through a 64-bit hash and confirmed by comparing the limbs, so a hash
+ * collision can never return the wrong result. The table is 4-way set
+ * associative with least-recently-used replacement inside a set, and its
+ * memory is allocated once. One mutex guards it: a lookup costs far less
+ * than the modexp it saves, so -j workers share a single table.
+ */
+typedef struct BlockMemo BlockMemo;
+
+// Room for about `entries` results of up to max_limbs limbs each; NULL on failure.
+BlockMemo *memo_create(size_t entries, size_t max_limbs);
+void       memo_free  (BlockMemo *memo);
+
+// A copy of the cached result for `in`, or NULL on a miss.
+BigInt *memo_get(BlockMemo *memo, const BigInt *in);
+// Remembers in -> out; values wider than max_limbs are not kept.
+void    memo_put(BlockMemo *memo, const BigInt *in, const BigInt *out);
+
+#endif
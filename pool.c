@@ -0,0 +1,336 @@
+#define _POSIX_C_SOURCE 200809L
+#include "pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Three-stage pipeline: one reader thread runs load, nthreads workers run
+ * compute, and the calling thread runs emit. Stages hand blocks over
+ * through a ring of slots whose state and counters are updated with
+ * atomics, so the common path takes no lock. A stage that has nothing to
+ * do spins briefly and then sleeps on the condition variable; the other
+ * stages only touch the mutex when someone is actually asleep.
+ */
+
+enum { SLOT_FREE, SLOT_LOADED, SLOT_DONE };
+
+#define SPIN_LIMIT 128
+
+typedef struct {
+    const PoolJob  *job;
+    unsigned char  *slots;     // window * stride bytes
+    size_t          stride;    // slot_size rounded up for alignment
+    int            *state;     // one SLOT_* per ring entry (atomic)
+    size_t          loaded;    // blocks published by the reader (atomic)
+    size_t          claimed;   // next block a worker will take (atomic)
+    size_t          emitted;   // blocks written by the writer (atomic)
+    int             eof;       // reader is done; `loaded` is final (atomic)
+    int             failed;    // some callback failed (atomic)
+    int             sleepers;  // threads waiting on cv (atomic)
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+} Pool;
+
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+static void *slot_at(Pool *p, size_t idx)
+{
+    return p->slots + (idx % p->job->window) * p->stride;
+}
+
+static void pool_wake(Pool *p)
+{
+    if (LOAD(p->sleepers) > 0) {
+        pthread_mutex_lock(&p->mu);
+        pthread_cond_broadcast(&p->cv);
+        pthread_mutex_unlock(&p->mu);
+    }
+}
+
+static void pool_fail(Pool *p)
+{
+    STORE(p->failed, 1);
+    pool_wake(p);
+}
+
+// Waits until ready(p, idx) holds or the pool has failed.
+static void pool_wait(Pool *p, bool (*ready)(Pool *, size_t), size_t idx)
+{
+    for (int i = 0; i < SPIN_LIMIT; ++i) {
+        if (ready(p, idx) || LOAD(p->failed)) return;
+    }
+    pthread_mutex_lock(&p->mu);
+    __atomic_add_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!ready(p, idx) && !LOAD(p->failed)) {
+        pthread_cond_wait(&p->cv, &p->mu);
+    }
+    __atomic_sub_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&p->mu);
+}
+
+static bool has_room(Pool *p, size_t idx)
+{
+    return idx - LOAD(p->emitted) < p->job->window;
+}
+
+static bool is_loaded(Pool *p, size_t idx)
+{
+    return idx < LOAD(p->loaded) || LOAD(p->eof);
+}
+
+static bool is_done(Pool *p, size_t idx)
+{
+    if (idx < LOAD(p->loaded)) return LOAD(p->state[idx % p->job->window]) == SLOT_DONE;
+    return LOAD(p->eof) && idx >= LOAD(p->loaded);
+}
+
+
+static void *pool_reader(void *arg)
+{
+    Pool *p = arg;
+    const PoolJob *job = p->job;
+
+    for (size_t idx = 0;; ++idx) {
+        pool_wait(p, has_room, idx);
+        if (LOAD(p->failed)) break;
+
+        int rc = job->load(job->ctx, idx, slot_at(p, idx));
+        if (rc <= 0) {
+            if (rc < 0) STORE(p->failed, 1);
+            break;
+        }
+        STORE(p->state[idx % job->window], SLOT_LOADED);
+        STORE(p->loaded, idx + 1);
+        pool_wake(p);
+    }
+    STORE(p->eof, 1);
+    pool_wake(p);
+    return NULL;
+}
+
+static void *pool_worker(void *arg)
+{
+    Pool *p = arg;
+    const PoolJob *job = p->job;
+
+    for (;;) {
+        size_t idx = __atomic_fetch_add(&p->claimed, 1, __ATOMIC_SEQ_CST);
+        pool_wait(p, is_loaded, idx);
+        if (LOAD(p->failed) || idx >= LOAD(p->loaded)) break;
+
+        if (job->compute(job->ctx, idx, slot_at(p, idx)) != 0) pool_fail(p);
+        STORE(p->state[idx % job->window], SLOT_DONE);
+        pool_wake(p);
+    }
+    return NULL;
+}
+
+// The calling thread writes blocks out in order.
+static void pool_writer(Pool *p)
+{
+    const PoolJob *job = p->job;
+
+    for (size_t idx = 0;; ++idx) {
+        pool_wait(p, is_done, idx);
+        if (LOAD(p->failed) || idx >= LOAD(p->loaded)) break;
+
+        if (job->emit(job->ctx, idx, slot_at(p, idx)) != 0) pool_fail(p);
+        STORE(p->state[idx % job->window], SLOT_FREE);
+        STORE(p->emitted, idx + 1);
+        pool_wake(p);
+    }
+}
+
+
+// With a single compute thread the stages run inline on the caller. The
+// reads and writes go through 1 MiB stdio buffers, so there is little I/O
+// left to overlap, while merely having other threads running switches
+// malloc to its locked path, which costs BigInt arithmetic far more.
+static int pool_run_serial(const PoolJob *job, void *slot)
+{
+    for (size_t idx = 0;; ++idx) {
+        int rc = job->load(job->ctx, idx, slot);
+        if (rc == 0) return 0;
+        if (rc < 0) return -1;
+        if (job->compute(job->ctx, idx, slot) != 0 || job->emit(job->ctx, idx, slot) != 0) {
+            if (job->discard) job->discard(job->ctx, slot);
+            return -1;
+        }
+    }
+}
+
+int pool_run_ordered(const PoolJob *job)
+{
+    if (!job || job->window == 0 || job->nthreads == 0) return -1;
+
+    if (job->nthreads == 1) {
+        void *slot = calloc(1, job->slot_size ? job->slot_size : 1);
+        if (!slot) { perror("calloc pool slots"); return -1; }
+        int rc = pool_run_serial(job, slot);
+        free(slot);
+        return rc;
+    }
+
+    Pool p = {0};
+    p.job    = job;
+    p.stride = (job->slot_size + 15) & ~(size_t)15;   // slots hold pointers and size_t
+    p.slots  = calloc(job->window, p.stride ? p.stride : 1);
+    p.state  = calloc(job->window, sizeof *p.state);
+    pthread_t *tids = malloc((job->nthreads + 1) * sizeof *tids);
+    if (!p.slots || !p.state || !tids) {
+        perror("calloc pool slots");
+        free(p.slots); free(p.state); free(tids); return -1;
+    }
+    pthread_mutex_init(&p.mu, NULL);
+    pthread_cond_init(&p.cv, NULL);
+
+    size_t started = 0;
+    bool reader_ok = pthread_create(&tids[started], NULL, pool_reader, &p) == 0;
+    if (reader_ok) started++;
+    for (size_t i = 0; reader_ok && i < job->nthreads; ++i) {
+        if (pthread_create(&tids[started], NULL, pool_worker, &p) != 0) break;
+        started++;
+    }
+    if (!reader_ok || started == 1) {
+        fprintf(stderr, "Error: could not start pipeline threads.\n");
+        pool_fail(&p);
+    } else if (started < job->nthreads + 1) {
+        fprintf(stderr, "Warning: could only start %zu of %zu worker threads.\n",
+                started - 1, job->nthreads);
+    }
+
+    if (started > 1) pool_writer(&p);
+    for (size_t i = 0; i < started; ++i) pthread_join(tids[i], NULL);
+
+    // After a failure some loaded blocks were never emitted; let the caller
+    // release whatever they own.
+    for (size_t i = 0; i < job->window; ++i) {
+        if (p.state[i] != SLOT_FREE && job->discard) {
+            job->discard(job->ctx, p.slots + i * p.stride);
+        }
+    }
+    int rc = p.failed ? -1 : 0;
+    free(tids);
+    free(p.state);
+    free(p.slots);
+    pthread_mutex_destroy(&p.mu);
+    pthread_cond_destroy(&p.cv);
+    return rc;
+}
+
+
+/* Shared fork-join pool. Groups of tasks wait on a list; a thread claims
+ * the next index of the first group under the mutex and runs it unlocked.
+ * The forking thread claims from its own group, then waits only for
+ * tasks other threads already started, which always finish.
+ */
+typedef struct TaskGroup {
+    void (*fn)(void *ctx, size_t i);
+    void  *ctx;
+    size_t ntasks;
+    size_t next;              // next index to hand out
+    size_t done;
+    struct TaskGroup *link;   // next group waiting for threads
+} TaskGroup;
+
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  work;     // a group was queued
+    pthread_cond_t  done;     // a group finished
+    TaskGroup      *queue;
+    size_t          nthreads; // requested, caller included
+    size_t          started;  // workers running
+} shared = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+             NULL, 1, 0 };
+
+// With the mutex held: hands out one index of g, unqueueing it once all are out.
+static size_t group_claim(TaskGroup *g)
+{
+    size_t i = g->next++;
+    if (g->next == g->ntasks) {
+        TaskGroup **pp = &shared.queue;
+        while (*pp != g) pp = &(*pp)->link;
+        *pp = g->link;
+    }
+    return i;
+}
+
+static void group_run(TaskGroup *g, size_t i)
+{
+    g->fn(g->ctx, i);
+    pthread_mutex_lock(&shared.mu);
+    if (++g->done == g->ntasks) pthread_cond_broadcast(&shared.done);
+    pthread_mutex_unlock(&shared.mu);
+}
+
+static void *shared_worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&shared.mu);
+    for (;;) {
+        while (!shared.queue) pthread_cond_wait(&shared.work, &shared.mu);
+        TaskGroup *g = shared.queue;
+        size_t i = group_claim(g);
+        pthread_mutex_unlock(&shared.mu);
+        group_run(g, i);
+        pthread_mutex_lock(&shared.mu);
+    }
+    return NULL;
+}
+
+void pool_shared_set_threads(size_t nthreads)
+{
+    pthread_mutex_lock(&shared.mu);
+    shared.nthreads = nthreads ? nthreads : 1;
+    pthread_mutex_unlock(&shared.mu);
+}
+
+size_t pool_shared_threads(void)
+{
+    pthread_mutex_lock(&shared.mu);
+    size_t n = shared.nthreads;
+    pthread_mutex_unlock(&shared.mu);
+    return n;
+}
+
+// With the mutex held: brings the worker count up to nthreads - 1.
+static void shared_start(void)
+{
+    while (shared.started + 1 < shared.nthreads) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, shared_worker, NULL) != 0) {
+            fprintf(stderr, "Warning: could only start %zu of %zu shared pool threads.\n",
+                    shared.started, shared.nthreads - 1);
+            shared.nthreads = shared.started + 1;
+            break;
+        }
+        pthread_detach(tid);
+        shared.started++;
+    }
+}
+
+void pool_fork_join(size_t ntasks, void (*fn)(void *ctx, size_t i), void *ctx)
+{
+    pthread_mutex_lock(&shared.mu);
+    shared_start();
+    if (shared.nthreads < 2 || shared.started == 0 || ntasks < 2) {
+        pthread_mutex_unlock(&shared.mu);
+        for (size_t i = 0; i < ntasks; ++i) fn(ctx, i);
+        return;
+    }
+    TaskGroup g = { fn, ctx, ntasks, 0, 0, NULL };
+    TaskGroup **pp = &shared.queue;
+    while (*pp) pp = &(*pp)->link;
+    *pp = &g;
+    pthread_cond_broadcast(&shared.work);
+    while (g.next < g.ntasks) {
+        size_t i = group_claim(&g);
+        pthread_mutex_unlock(&shared.mu);
+        group_run(&g, i);
+        pthread_mutex_lock(&shared.mu);
+    }
+    while (g.done < g.ntasks) pthread_cond_wait(&shared.done, &shared.mu);
+    pthread_mutex_unlock(&shared.mu);
+}
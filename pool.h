@@ -0,0 +1,43 @@
+#ifndef POOL_H
+#define POOL_H
+#include <stddef.h>
+
+/* Ordered block pipeline.
+ *
+ * Blocks are numbered 0,1,2,... and pass through three callbacks, each
+ * on its own thread(s), so reading, computing and writing overlap:
+ *   load    - reader thread, in index order; fills the slot.
+ *             Returns 1 if a block was loaded, 0 at end of input, -1 on error.
+ *   compute - nthreads worker threads, in parallel; returns 0 on success.
+ *   emit    - the calling thread, in index order; returns 0 on success.
+ * At most `window` blocks are between load and emit at any time, so memory
+ * use is window * slot_size no matter how long the input is. Because
+ * emit sees blocks in order, the output is identical to a serial loop.
+ * With nthreads == 1 the three callbacks simply run in turn on the caller.
+ */
+typedef struct {
+    size_t nthreads;     // compute threads (>= 1); reader and writer are extra
+    size_t window;       // max blocks in flight
+    size_t slot_size;    // bytes of per-block state handed to the callbacks
+    void  *ctx;
+    int  (*load)   (void *ctx, size_t idx, void *slot);
+    int  (*compute)(void *ctx, size_t idx, void *slot);
+    int  (*emit)   (void *ctx, size_t idx, void *slot);
+    void (*discard)(void *ctx, void *slot);  // optional: frees slots skipped after a failure
+} PoolJob;
+
+// Returns 0 on success, -1 if any callback failed (remaining blocks are dropped).
+int pool_run_ordered(const PoolJob *job);
+
+/* Shared fork-join pool, for splitting one large computation (bi_mul on
+ * huge operands) across cores. pool_fork_join runs fn(ctx, i) for every
+ * i < ntasks and returns when all have finished. The caller runs tasks
+ * too, and a task may fork again, so nesting cannot deadlock. Worker
+ * threads start on first use and stay until exit. With fewer than two
+ * threads set, the tasks simply run in turn on the caller.
+ */
+void   pool_shared_set_threads(size_t nthreads);   // total, caller included; 1 turns it off
+size_t pool_shared_threads(void);
+void   pool_fork_join(size_t ntasks, void (*fn)(void *ctx, size_t i), void *ctx);
+
+#endif
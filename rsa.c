@@ -1,5 +1,6 @@
 
 #include "rsa.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h> 
@@ -67,11 +68,30 @@ void rsa_generate_keypair(RSAKey *pub, RSAKey *priv, size_t bits_unused)
 }
 
 
+// Public exponents fit in one limb (65537, 3, ...), so encryption takes
+// the fixed addition-chain path instead of the generic bit loop.
 void rsa_encrypt(const BigInt *m, const RSAKey *pub,  BigInt **c)
-{ bi_modexp(m, pub ->exp, pub ->n, c); }
+{
+    uint64_t t0 = stats_now();
+    if (pub->exp->len == 1) bi_modexp_small(m, pub->exp->limbs[0], pub->n, c);
+    else                    bi_modexp(m, pub ->exp, pub ->n, c);
+    stats_modexp_done(t0);
+}
+
+static size_t decrypt_threads = 1;
+
+void rsa_set_decrypt_threads(size_t threads)
+{
+    decrypt_threads = threads ? threads : 1;
+}
 
 void rsa_decrypt(const BigInt *c, const RSAKey *priv, BigInt **m)
-{ bi_modexp(c, priv->exp, priv->n, m); }
+{
+    uint64_t t0 = stats_now();
+    if (decrypt_threads > 1) bi_modexp_par(c, priv->exp, priv->n, decrypt_threads, m);
+    else                     bi_modexp(c, priv->exp, priv->n, m);
+    stats_modexp_done(t0);
+}
 
 bool rsa_save_key(const char *file, const RSAKey *k, const char *lbl)
 {
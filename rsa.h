@@ -7,6 +7,9 @@ typedef struct { BigInt *n, *exp; } RSAKey;
 void rsa_generate_keypair(RSAKey *pub, RSAKey *priv, size_t bits);
 void rsa_encrypt(const BigInt *m,const RSAKey *pub ,BigInt **c);
 void rsa_decrypt(const BigInt *c,const RSAKey *priv,BigInt **m);
+// Threads for each rsa_decrypt exponentiation (bi_modexp_par), 1 = serial.
+// Set once before any decryption starts; trades throughput for latency.
+void rsa_set_decrypt_threads(size_t threads);
 
 bool rsa_save_key(const char *file,const RSAKey *k,const char *label);
 bool rsa_load_key(const char *file,RSAKey *k);
@@ -0,0 +1,488 @@
+#define _POSIX_C_SOURCE 200809L
+#include "serve.h"
+#include "rsa.h"
+#include "container.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define REQ_HEADER_SIZE 5
+#define READ_CHUNK      65536
+
+// Keys and derived geometry, loaded once for the life of the server.
+typedef struct {
+    RSAKey   pub, priv;
+    CtHeader geo;
+} Prepared;
+
+typedef struct Conn {
+    int            fd;
+    unsigned char *in;          // received bytes not yet consumed
+    size_t         in_len, in_cap;
+    unsigned char *out;         // reply being written
+    size_t         out_len, out_pos;
+    bool           busy;        // a request is with the workers
+    bool           dead;        // closed; freed once no worker or event refers to it
+    bool           hangup;      // close once the current reply is written
+    struct Conn   *prev_all, *next_all;  // every open connection
+    unsigned char  op;          // request being processed
+    size_t         req_len;
+    struct Conn   *next;        // work, completion or graveyard link
+} Conn;
+
+typedef struct {
+    Prepared        key;
+    int             epfd, evfd, lfd;
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+    Conn           *work_head, *work_tail;
+    Conn           *done_head;
+    Conn           *all;        // open connections, owned by the event loop
+    Conn           *graveyard;  // closed, freed after the current epoll batch
+    bool            stopping;
+} Server;
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_signal(int sig) { (void)sig; g_stop = 1; }
+
+
+static bool set_nonblock(int fd)
+{
+    int fl = fcntl(fd, F_GETFL);
+    return fl >= 0 && fcntl(fd, F_SETFL, fl | O_NONBLOCK) == 0;
+}
+
+static bool key_prepare(Prepared *k)
+{
+    if (!rsa_load_key("public.key", &k->pub)) return false;
+    if (!rsa_load_key("private.key", &k->priv)) { rsa_free_key(&k->pub); return false; }
+    if (bi_cmp(k->pub.n, k->priv.n) != 0 || bi_bitlen(k->pub.n) <= 8) {
+        fprintf(stderr, "Error: public.key and private.key do not form a usable pair.\n");
+        rsa_free_key(&k->pub); rsa_free_key(&k->priv); return false;
+    }
+    ct_header_init(&k->geo, k->pub.n);
+    return true;
+}
+
+// Reply buffer: status | length | payload, payload left for the caller.
+static unsigned char *reply_alloc(unsigned char status, size_t payload, size_t *total)
+{
+    *total = REQ_HEADER_SIZE + payload;
+    unsigned char *r = malloc(*total);
+    if (!r) return NULL;
+    r[0] = status;
+    ct_put_be32(r + 1, (uint32_t)payload);
+    return r;
+}
+
+static unsigned char *reply_error(const char *msg, size_t *total)
+{
+    size_t n = strlen(msg);
+    unsigned char *r = reply_alloc(1, n, total);
+    if (r) memcpy(r + REQ_HEADER_SIZE, msg, n);
+    return r;
+}
+
+static unsigned char *do_encrypt(const Prepared *k, const unsigned char *in, size_t len, size_t *total)
+{
+    const CtHeader *g = &k->geo;
+    uint64_t nblocks = (len + g->block_size - 1) / g->block_size;
+    size_t body = CT_HEADER_SIZE + nblocks * g->mod_bytes + CT_TRAILER_SIZE;
+    unsigned char *r = reply_alloc(0, body, total);
+    if (!r) return reply_error("out of memory", total);
+
+    unsigned char *p = r + REQ_HEADER_SIZE;
+    ct_encode_header(p, g);
+    CtTrailer tr = { nblocks, 0 };
+    for (uint64_t i = 0; i < nblocks; ++i) {
+        size_t pos = i * g->block_size;
+        size_t n = (len - pos < g->block_size) ? len - pos : g->block_size;
+        BigInt *m = bi_from_bytes_be(in + pos, n), *c = NULL;
+        if (m) rsa_encrypt(m, &k->pub, &c);
+        bool ok = c && bi_to_bytes_be(c, p + ct_block_offset(g, i), g->mod_bytes);
+        bi_free(m); bi_free(c);
+        if (!ok) { free(r); return reply_error("encryption failed", total); }
+        tr.last_len = (uint32_t)n;
+    }
+    ct_encode_trailer(p + ct_block_offset(g, nblocks), &tr);
+    return r;
+}
+
+static unsigned char *do_decrypt(const Prepared *k, const unsigned char *in, size_t len, size_t *total)
+{
+    CtHeader h;
+    CtTrailer tr;
+    if (len < CT_HEADER_SIZE + CT_TRAILER_SIZE || !ct_decode_header(in, &h) ||
+        !ct_decode_trailer(in + len - CT_TRAILER_SIZE, &tr)) {
+        return reply_error("payload is not a binary ciphertext container", total);
+    }
+    if (!ct_validate(&h, &tr, k->priv.n, len)) {
+        return reply_error("container does not match the server key", total);
+    }
+    if (h.flags & CT_FLAG_LZ) {
+        return reply_error("compressed containers are not supported", total);
+    }
+
+    size_t plain = (size_t)ct_plain_size(&h, &tr);
+    unsigned char *r = reply_alloc(0, plain, total);
+    if (!r) return reply_error("out of memory", total);
+
+    unsigned char *p = r + REQ_HEADER_SIZE;
+    for (uint64_t i = 0; i < tr.nblocks; ++i) {
+        BigInt *c = bi_from_bytes_be(in + ct_block_offset(&h, i), h.mod_bytes), *m = NULL;
+        if (c) rsa_decrypt(c, &k->priv, &m);
+        bool ok = m && bi_to_bytes_be(m, p + i * h.block_size, ct_block_len(&h, &tr, i));
+        bi_free(c); bi_free(m);
+        if (!ok) { free(r); return reply_error("decryption failed", total); }
+    }
+    return r;
+}
+
+
+static void *worker_main(void *arg)
+{
+    Server *sv = arg;
+    for (;;) {
+        pthread_mutex_lock(&sv->mu);
+        while (!sv->work_head && !sv->stopping) pthread_cond_wait(&sv->cv, &sv->mu);
+        if (!sv->work_head) { pthread_mutex_unlock(&sv->mu); return NULL; }
+        Conn *c = sv->work_head;
+        sv->work_head = c->next;
+        if (!sv->work_head) sv->work_tail = NULL;
+        pthread_mutex_unlock(&sv->mu);
+
+        const unsigned char *payload = c->in + REQ_HEADER_SIZE;
+        size_t total = 0;
+        unsigned char *reply = (c->op == 'E') ? do_encrypt(&sv->key, payload, c->req_len, &total)
+                             : (c->op == 'D') ? do_decrypt(&sv->key, payload, c->req_len, &total)
+                             : reply_error("unknown operation", &total);
+
+        pthread_mutex_lock(&sv->mu);
+        c->out = reply;
+        c->out_len = reply ? total : 0;
+        c->out_pos = 0;
+        c->next = sv->done_head;
+        sv->done_head = c;
+        pthread_mutex_unlock(&sv->mu);
+
+        uint64_t one = 1;
+        if (write(sv->evfd, &one, sizeof one) < 0 && errno != EAGAIN) perror("eventfd write");
+    }
+}
+
+
+static void conn_free(Conn *c)
+{
+    if (c->fd >= 0) close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+// A later event of the same epoll batch may still point at c, so closed
+// connections are only freed by free_graveyard once the batch is done.
+static void conn_bury(Server *sv, Conn *c)
+{
+    c->next = sv->graveyard;
+    sv->graveyard = c;
+}
+
+static void free_graveyard(Server *sv)
+{
+    while (sv->graveyard) {
+        Conn *c = sv->graveyard;
+        sv->graveyard = c->next;
+        conn_free(c);
+    }
+}
+
+static void conn_close(Server *sv, Conn *c)
+{
+    epoll_ctl(sv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    if (c->prev_all) c->prev_all->next_all = c->next_all; else sv->all = c->next_all;
+    if (c->next_all) c->next_all->prev_all = c->prev_all;
+    close(c->fd); c->fd = -1;
+    c->dead = true;
+    if (!c->busy) conn_bury(sv, c);   // else a worker owns c; buried on completion
+}
+
+static void conn_watch(Server *sv, Conn *c, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(sv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static bool conn_flush(Server *sv, Conn *c);
+
+// Hands the next buffered request to the workers, if a whole one is
+// there. An oversized request is answered with an error, after which the
+// connection is closed: its payload cannot be skipped reliably. Returns
+// false if the connection should be closed now.
+static bool conn_dispatch(Server *sv, Conn *c)
+{
+    if (c->busy || c->out || c->in_len < REQ_HEADER_SIZE) return true;
+    size_t len = ct_get_be32(c->in + 1);
+    if (len > SERVE_MAX_PAYLOAD) {
+        c->out = reply_error("payload exceeds the 64 MiB request limit", &c->out_len);
+        c->out_pos = 0;
+        c->hangup = true;
+        return c->out && conn_flush(sv, c);
+    }
+    if (c->in_len < REQ_HEADER_SIZE + len) return true;
+
+    c->op = c->in[0];
+    c->req_len = len;
+    c->busy = true;
+    conn_watch(sv, c, 0);      // one request at a time per connection
+
+    pthread_mutex_lock(&sv->mu);
+    c->next = NULL;
+    if (sv->work_tail) sv->work_tail->next = c; else sv->work_head = c;
+    sv->work_tail = c;
+    pthread_cond_signal(&sv->cv);
+    pthread_mutex_unlock(&sv->mu);
+    return true;
+}
+
+// Writes as much of the reply as the socket takes. Returns false on error.
+static bool conn_flush(Server *sv, Conn *c)
+{
+    while (c->out_pos < c->out_len) {
+        ssize_t n = write(c->fd, c->out + c->out_pos, c->out_len - c->out_pos);
+        if (n < 0 && errno == EAGAIN) { conn_watch(sv, c, EPOLLOUT); return true; }
+        if (n < 0) return false;
+        c->out_pos += (size_t)n;
+    }
+    if (c->hangup) return false;
+
+    // Reply done: drop the request from the input and look for the next.
+    free(c->out); c->out = NULL; c->out_len = c->out_pos = 0;
+    size_t used = REQ_HEADER_SIZE + c->req_len;
+    memmove(c->in, c->in + used, c->in_len - used);
+    c->in_len -= used;
+    conn_watch(sv, c, EPOLLIN);
+    return conn_dispatch(sv, c);
+}
+
+static bool conn_read(Server *sv, Conn *c)
+{
+    for (;;) {
+        // Until the header is in, read ahead a chunk; then the buffer is
+        // grown to exactly the request. conn_dispatch has already answered
+        // a length over the limit, so it is never allocated.
+        size_t need = READ_CHUNK;
+        if (c->in_len >= REQ_HEADER_SIZE) need = REQ_HEADER_SIZE + ct_get_be32(c->in + 1);
+        if (c->in_cap < need) {
+            unsigned char *p = realloc(c->in, need);
+            if (!p) return false;
+            c->in = p; c->in_cap = need;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n == 0) return false;
+        if (n < 0) return errno == EAGAIN;
+        c->in_len += (size_t)n;
+        if (!conn_dispatch(sv, c)) return false;
+        if (c->busy || c->out) return true;   // stop reading until the reply is out
+    }
+}
+
+static void accept_all(Server *sv)
+{
+    for (;;) {
+        int fd = accept(sv->lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR) perror("accept");
+            return;
+        }
+        Conn *c = calloc(1, sizeof *c);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (!c || !set_nonblock(fd) || epoll_ctl(sv->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd); free(c); continue;
+        }
+        c->fd = fd;
+        c->next_all = sv->all;
+        if (sv->all) sv->all->prev_all = c;
+        sv->all = c;
+    }
+}
+
+static void drain_completions(Server *sv)
+{
+    uint64_t cnt;
+    if (read(sv->evfd, &cnt, sizeof cnt) < 0 && errno != EAGAIN) perror("eventfd read");
+
+    pthread_mutex_lock(&sv->mu);
+    Conn *list = sv->done_head;
+    sv->done_head = NULL;
+    pthread_mutex_unlock(&sv->mu);
+
+    while (list) {
+        Conn *c = list;
+        list = c->next;
+        c->busy = false;
+        if (c->dead) { conn_bury(sv, c); continue; }
+        if (!c->out) {
+            fprintf(stderr, "Warning: out of memory building a reply; dropping connection.\n");
+            conn_close(sv, c); continue;
+        }
+        if (!conn_flush(sv, c)) conn_close(sv, c);
+    }
+}
+
+
+// A server that died without cleaning up leaves its socket file behind.
+// Only such a socket is removed: anything else at the path, or a socket a
+// live server still accepts on, is left alone and reported.
+static bool clear_stale_socket(const char *path, const struct sockaddr_un *addr)
+{
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        if (errno == ENOENT) return true;
+        perror(path);
+        return false;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Error: %s exists and is not a socket; not replacing it.\n", path);
+        return false;
+    }
+    // Non-blocking, so a live server with a full backlog answers EAGAIN
+    // instead of stalling the probe.
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || !set_nonblock(fd)) {
+        perror("socket");
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    int rc = connect(fd, (const struct sockaddr *)addr, sizeof *addr);
+    int err = errno;
+    close(fd);
+    if (rc == 0 || err != ECONNREFUSED) {
+        fprintf(stderr, "Error: %s is in use by a running server.\n", path);
+        return false;
+    }
+    if (unlink(path) != 0 && errno != ENOENT) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+int serve_run(const char *socket_path, size_t nthreads)
+{
+    Server sv;
+    memset(&sv, 0, sizeof sv);
+    sv.epfd = sv.evfd = sv.lfd = -1;
+    if (!key_prepare(&sv.key)) {
+        fprintf(stderr, "Error: serve needs public.key and private.key (generate via 'enc' mode first).\n");
+        return 1;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "Error: Socket path too long.\n");
+        rsa_free_key(&sv.key.pub); rsa_free_key(&sv.key.priv); return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    if (!clear_stale_socket(socket_path, &addr)) {
+        rsa_free_key(&sv.key.pub); rsa_free_key(&sv.key.priv); return 1;
+    }
+
+    sv.lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sv.epfd = epoll_create1(0);
+    sv.evfd = eventfd(0, EFD_NONBLOCK);
+    struct epoll_event lev = { .events = EPOLLIN, .data.ptr = &sv.lfd };
+    struct epoll_event eev = { .events = EPOLLIN, .data.ptr = &sv.evfd };
+    if (sv.lfd < 0 || sv.epfd < 0 || sv.evfd < 0 ||
+        bind(sv.lfd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(sv.lfd, 128) != 0 ||
+        !set_nonblock(sv.lfd) ||
+        epoll_ctl(sv.epfd, EPOLL_CTL_ADD, sv.lfd, &lev) != 0 ||
+        epoll_ctl(sv.epfd, EPOLL_CTL_ADD, sv.evfd, &eev) != 0) {
+        perror(socket_path);
+        if (sv.lfd >= 0) close(sv.lfd);
+        if (sv.epfd >= 0) close(sv.epfd);
+        if (sv.evfd >= 0) close(sv.evfd);
+        rsa_free_key(&sv.key.pub); rsa_free_key(&sv.key.priv); return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_signal;      // no SA_RESTART: epoll_wait returns EINTR
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&sv.mu, NULL);
+    pthread_cond_init(&sv.cv, NULL);
+    pthread_t *tids = calloc(nthreads, sizeof *tids);
+    size_t started = 0;
+    for (size_t i = 0; tids && i < nthreads; ++i) {
+        if (pthread_create(&tids[i], NULL, worker_main, &sv) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: could not start worker threads.\n");
+        g_stop = 1;
+    }
+
+    fprintf(stderr, "Serving on %s with %zu worker(s).\n", socket_path, started);
+    struct epoll_event evs[64];
+    while (!g_stop) {
+        int n = epoll_wait(sv.epfd, evs, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait"); break;
+        }
+        for (int i = 0; i < n; ++i) {
+            void *tag = evs[i].data.ptr;
+            if (tag == &sv.lfd) { accept_all(&sv); continue; }
+            if (tag == &sv.evfd) { drain_completions(&sv); continue; }
+
+            Conn *c = tag;
+            if (c->dead) continue;          // closed earlier in this batch
+            bool ok = true;
+            if (evs[i].events & EPOLLOUT) ok = conn_flush(&sv, c);
+            else if (evs[i].events & EPOLLIN) ok = conn_read(&sv, c);
+            else if (evs[i].events & (EPOLLHUP | EPOLLERR)) ok = false;
+            if (!ok) conn_close(&sv, c);
+        }
+        free_graveyard(&sv);
+    }
+
+    pthread_mutex_lock(&sv.mu);
+    sv.stopping = true;
+    pthread_cond_broadcast(&sv.cv);
+    pthread_mutex_unlock(&sv.mu);
+    for (size_t i = 0; i < started; ++i) pthread_join(tids[i], NULL);
+    free(tids);
+
+    // Workers are gone, so every connection (and finished reply) is ours.
+    while (sv.done_head) {
+        Conn *c = sv.done_head;
+        sv.done_head = c->next;
+        c->busy = false;
+        if (c->dead) conn_bury(&sv, c);
+    }
+    while (sv.all) conn_close(&sv, sv.all);
+    free_graveyard(&sv);
+    close(sv.lfd);
+    close(sv.evfd);
+    close(sv.epfd);
+    unlink(socket_path);
+    pthread_mutex_destroy(&sv.mu);
+    pthread_cond_destroy(&sv.cv);
+    rsa_free_key(&sv.key.pub);
+    rsa_free_key(&sv.key.priv);
+    fprintf(stderr, "Server stopped.\n");
+    return 0;
+}
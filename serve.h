@@ -0,0 +1,23 @@
+#ifndef SERVE_H
+#define SERVE_H
+#include <stddef.h>
+
+/* Long-running encrypt/decrypt service on a Unix domain socket.
+ *
+ * Keys are loaded once from public.key and private.key. Each request is
+ *     op (1 byte: 'E' encrypt, 'D' decrypt) | length (4 bytes, big-endian) | payload
+ * and is answered with
+ *     status (1 byte: 0 ok, 1 error) | length (4 bytes, big-endian) | payload
+ * An 'E' payload is plaintext and the reply is a binary container (see
+ * container.h); a 'D' payload is a binary container and the reply is the
+ * plaintext. On error the reply payload is a message. A connection may
+ * send any number of requests; replies come back in request order.
+ *
+ * One epoll thread does all socket I/O and hands complete requests to
+ * `nthreads` workers. Runs until SIGINT or SIGTERM.
+ */
+#define SERVE_MAX_PAYLOAD (64u << 20)
+
+int serve_run(const char *socket_path, size_t nthreads);
+
+#endif
@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L
+#include "shard.h"
+#include "container.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define COPY_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    const char *path;
+    CtPart      part;
+} PartFile;
+
+static bool same_file(const CtPart *a, const CtPart *b)
+{
+    return a->hdr.key_id == b->hdr.key_id && a->hdr.mod_bytes == b->hdr.mod_bytes &&
+           a->hdr.block_size == b->hdr.block_size && a->kind == b->kind &&
+           a->shards == b->shards && a->whole.nblocks == b->whole.nblocks &&
+           a->whole.last_len == b->whole.last_len;
+}
+
+// Reads and checks one part header, including that the file holds
+// exactly the payload the header announces.
+static bool read_part(PartFile *pf)
+{
+    FILE *fp = fopen(pf->path, "rb");
+    if (!fp) { perror(pf->path); return false; }
+    unsigned char raw[CT_PART_HEADER_SIZE];
+    struct stat st;
+    bool ok = fread(raw, 1, sizeof raw, fp) == sizeof raw && ct_decode_part(raw, &pf->part);
+    if (!ok) {
+        fprintf(stderr, "Error: %s is not a shard part file.\n", pf->path);
+    } else if (fstat(fileno(fp), &st) != 0 ||
+               (uint64_t)st.st_size != CT_PART_HEADER_SIZE + ct_part_payload(&pf->part)) {
+        fprintf(stderr, "Error: %s is truncated or has trailing data.\n", pf->path);
+        ok = false;
+    }
+    fclose(fp);
+    return ok;
+}
+
+static bool copy_payload(const char *path, FILE *out, unsigned char *buf)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { perror(path); return false; }
+    bool ok = fseek(fp, CT_PART_HEADER_SIZE, SEEK_SET) == 0;
+    size_t n;
+    while (ok && (n = fread(buf, 1, COPY_BUFFER_SIZE, fp)) > 0) {
+        ok = fwrite(buf, 1, n, out) == n;
+    }
+    if (ok && ferror(fp)) ok = false;
+    if (!ok) fprintf(stderr, "Error copying %s into the merged output.\n", path);
+    fclose(fp);
+    return ok;
+}
+
+int shard_merge(const char *out_path, const char *const *parts, size_t nparts)
+{
+    if (nparts == 0) return -1;
+    PartFile *pf = calloc(nparts, sizeof *pf);
+    if (!pf) { perror("calloc parts"); return -1; }
+
+    int rc = -1;
+    FILE *out = NULL;
+    unsigned char *buf = NULL;
+    for (size_t i = 0; i < nparts; ++i) {
+        pf[i].path = parts[i];
+        if (!read_part(&pf[i])) goto merge_done;
+        if (!same_file(&pf[i].part, &pf[0].part)) {
+            fprintf(stderr, "Error: %s does not belong to the same sharded run as %s.\n", parts[i], parts[0]);
+            goto merge_done;
+        }
+    }
+    if (nparts != pf[0].part.shards) {
+        fprintf(stderr, "Error: Got %zu parts for a run of %u shards.\n", nparts, pf[0].part.shards);
+        goto merge_done;
+    }
+    // Order by shard index; with the count checked, a duplicate shows up
+    // as a gap.
+    for (size_t i = 1; i < nparts; ++i) {
+        PartFile key = pf[i];
+        size_t j = i;
+        for (; j > 0 && pf[j - 1].part.shard > key.part.shard; --j) pf[j] = pf[j - 1];
+        pf[j] = key;
+    }
+    for (size_t i = 0; i < nparts; ++i) {
+        if (pf[i].part.shard != i) {
+            fprintf(stderr, "Error: Shard %zu of %zu is missing.\n", i, nparts);
+            goto merge_done;
+        }
+    }
+
+    buf = malloc(COPY_BUFFER_SIZE);
+    out = fopen(out_path, "wb");
+    if (!buf || !out) { perror(out_path); goto merge_done; }
+
+    const CtPart *p0 = &pf[0].part;
+    if (p0->kind == CT_PART_CIPHER) {
+        unsigned char raw_hdr[CT_HEADER_SIZE];
+        ct_encode_header(raw_hdr, &p0->hdr);
+        if (fwrite(raw_hdr, 1, sizeof raw_hdr, out) != sizeof raw_hdr) goto write_error;
+    }
+    for (size_t i = 0; i < nparts; ++i) {
+        if (!copy_payload(pf[i].path, out, buf)) goto merge_done;
+    }
+    if (p0->kind == CT_PART_CIPHER) {
+        unsigned char raw_tr[CT_TRAILER_SIZE];
+        ct_encode_trailer(raw_tr, &p0->whole);
+        if (fwrite(raw_tr, 1, sizeof raw_tr, out) != sizeof raw_tr) goto write_error;
+    }
+    rc = 0;
+    goto merge_done;
+
+write_error:
+    fprintf(stderr, "Error writing %s.\n", out_path);
+merge_done:
+    if (out && fclose(out) != 0) { perror(out_path); rc = -1; }
+    if (out && rc != 0) {
+        struct stat st;
+        if (stat(out_path, &st) == 0 && S_ISREG(st.st_mode)) remove(out_path);
+    }
+    free(buf);
+    free(pf);
+    return rc;
+}
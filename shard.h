@@ -0,0 +1,13 @@
+#ifndef SHARD_H
+#define SHARD_H
+#include <stddef.h>
+
+/* Joins the part files written by `enc|dec --shards K --shard i` (see
+ * CtPart in container.h). The parts may be given in any order; all K must
+ * be present and agree on key, geometry and file length. Ciphertext parts
+ * become one binary container, byte-identical to a single `enc` run;
+ * plaintext parts become the plaintext. Returns 0 on success.
+ */
+int shard_merge(const char *out_path, const char *const *parts, size_t nparts);
+
+#endif
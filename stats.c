@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+#include "BigInt.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+bool stats_on = false;
+__thread StatBlock *stats_tls = NULL;
+
+// Blocks outlive their threads so that the report can still sum them.
+typedef struct StatNode {
+    StatBlock        block;
+    struct StatNode *next;
+} StatNode;
+
+static pthread_mutex_t stats_mu = PTHREAD_MUTEX_INITIALIZER;
+static StatNode *stats_all = NULL;
+static uint64_t  stats_start = 0;
+
+static const char *const STAT_NAMES[ST_COUNTERS] = {
+    "muladd", "mul_calls", "divmod_calls", "divmod_iters", "allocs", "alloc_bytes",
+    "modexp_blocks", "modexp_ns", "read_bytes", "read_ns", "write_bytes", "write_ns",
+    "memo_hits", "memo_misses",
+};
+
+static uint64_t clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+StatBlock *stats_thread_block(void)
+{
+    StatNode *n = calloc(1, sizeof *n);
+    if (!n) return NULL;
+    pthread_mutex_lock(&stats_mu);
+    n->next = stats_all;
+    stats_all = n;
+    pthread_mutex_unlock(&stats_mu);
+    stats_tls = &n->block;
+    return stats_tls;
+}
+
+void stats_enable(void)
+{
+    stats_start = clock_ns();
+    stats_on = true;
+}
+
+uint64_t stats_now(void)
+{
+    return stats_on ? clock_ns() : 0;
+}
+
+void stats_modexp_done(uint64_t t0)
+{
+    if (!t0) return;
+    uint64_t dt = stats_now() - t0;
+    StatBlock *b = stats_tls ? stats_tls : stats_thread_block();
+    if (!b) return;
+    b->v[ST_MODEXP_BLOCKS]++;
+    b->v[ST_MODEXP_NS] += dt;
+    int bucket = 0;
+    while (bucket + 1 < ST_HIST_BUCKETS && (dt >> (bucket + 1)) != 0) bucket++;
+    b->hist[bucket]++;
+}
+
+void stats_report(FILE *out, bool json)
+{
+    if (!stats_on) return;
+    StatBlock sum = { {0}, {0} };
+    size_t threads = 0;
+    pthread_mutex_lock(&stats_mu);
+    for (StatNode *n = stats_all; n; n = n->next, ++threads) {
+        for (int i = 0; i < ST_COUNTERS; ++i)     sum.v[i] += n->block.v[i];
+        for (int i = 0; i < ST_HIST_BUCKETS; ++i) sum.hist[i] += n->block.hist[i];
+    }
+    pthread_mutex_unlock(&stats_mu);
+    double wall = (clock_ns() - stats_start) / 1e9;
+    BiAllocStats mem;
+    bi_alloc_total_stats(&mem);
+
+    if (json) {
+        fprintf(out, "{\"wall_s\": %.6f, \"threads\": %zu", wall, threads);
+        for (int i = 0; i < ST_COUNTERS; ++i) fprintf(out, ", \"%s\": %llu", STAT_NAMES[i], (unsigned long long)sum.v[i]);
+        fprintf(out, ", \"live_bytes\": %lld, \"peak_thread_bytes\": %lld",
+                (long long)mem.live_bytes, (long long)mem.peak_bytes);
+        fprintf(out, ", \"modexp_hist_ns\": [");
+        bool first = true;
+        for (int i = 0; i < ST_HIST_BUCKETS; ++i) {
+            if (!sum.hist[i]) continue;
+            fprintf(out, "%s{\"lo\": %llu, \"count\": %llu}", first ? "" : ", ",
+                    1ULL << i, (unsigned long long)sum.hist[i]);
+            first = false;
+        }
+        fprintf(out, "]}\n");
+        return;
+    }
+
+    fprintf(out, "--- stats: %.3f s wall, %zu thread(s) ---\n", wall, threads);
+    for (int i = 0; i < ST_COUNTERS; ++i) {
+        fprintf(out, "  %-14s %llu\n", STAT_NAMES[i], (unsigned long long)sum.v[i]);
+    }
+    fprintf(out, "  %-14s %lld\n  %-14s %lld\n", "live_bytes", (long long)mem.live_bytes,
+            "peak_thread_bytes", (long long)mem.peak_bytes);
+    if (sum.v[ST_MODEXP_BLOCKS]) {
+        fprintf(out, "  modexp latency (mean %.1f us):\n", sum.v[ST_MODEXP_NS] / 1e3 / sum.v[ST_MODEXP_BLOCKS]);
+        for (int i = 0; i < ST_HIST_BUCKETS; ++i) {
+            if (!sum.hist[i]) continue;
+            fprintf(out, "    %10.1f us .. %10.1f us  %llu\n", (1ULL << i) / 1e3, (2ULL << i) / 1e3,
+                    (unsigned long long)sum.hist[i]);
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Hot-path counters and timers.
+ *
+ * Always compiled in, off until stats_enable() (rsa_run --stats). When off
+ * every hook is one load and a predictable branch. When on, each thread
+ * adds into its own block of counters, so workers never share a cache
+ * line; stats_report() sums the blocks of all threads that ever counted.
+ */
+typedef enum {
+    ST_MULADD,          // limb multiply-adds in bi_mul
+    ST_MUL_CALLS,
+    ST_DIVMOD_CALLS,
+    ST_DIVMOD_ITERS,    // quotient limbs from bi_divmod's long-division base case
+    ST_ALLOCS,          // BigInt allocations, including growth
+    ST_ALLOC_BYTES,
+    ST_MODEXP_BLOCKS,   // rsa_encrypt / rsa_decrypt calls
+    ST_MODEXP_NS,
+    ST_READ_BYTES,
+    ST_READ_NS,
+    ST_WRITE_BYTES,
+    ST_WRITE_NS,
+    ST_MEMO_HITS,       // --memo: blocks answered from the cache
+    ST_MEMO_MISSES,
+    ST_COUNTERS
+} StatId;
+
+// Per-block modexp latency, bucket i counts [2^i, 2^(i+1)) ns.
+#define ST_HIST_BUCKETS 40
+
+typedef struct {
+    uint64_t v[ST_COUNTERS];
+    uint64_t hist[ST_HIST_BUCKETS];
+} StatBlock;
+
+extern bool stats_on;
+extern __thread StatBlock *stats_tls;
+
+StatBlock *stats_thread_block(void);
+
+void     stats_enable(void);
+uint64_t stats_now(void);                 // monotonic ns, 0 when stats are off
+void     stats_modexp_done(uint64_t t0);  // t0 from stats_now()
+void     stats_report(FILE *out, bool json);
+
+static inline void stats_add(StatId id, uint64_t v)
+{
+    if (!stats_on) return;
+    StatBlock *b = stats_tls ? stats_tls : stats_thread_block();
+    if (b) b->v[id] += v;
+}
+
+// Adds the time since t0 to `id`; t0 == 0 means stats were off at the start.
+static inline void stats_time(StatId id, uint64_t t0)
+{
+    if (t0) stats_add(id, stats_now() - t0);
+}
+
+#endif
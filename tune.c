@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+#include "BigInt.h"
+#include "bench_util.h"
+#include "rsa.h"
+#include "pool.h"
+#include "tune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Host tuner behind `make tune`: times the kernels whose algorithm choice
+ * depends on a size threshold and writes bi_tune.h (see tune.h).
+ *
+ *   karatsuba  schoolbook against one Karatsuba level on n x n limbs; the
+ *              threshold is the first size where Karatsuba wins twice running.
+ *   ntt        Karatsuba against the number-theoretic transform, same rule.
+ *   par        serial against pool-split bi_mul with one thread per CPU
+ *              (kept at the default on a single CPU).
+ *   bz, newton the same for bi_divmod: algorithm D against Burnikel-Ziegler
+ *              on 2n / n limbs, then that against Newton + Barrett on 4n / n.
+ *   window     modular squaring and multiply costs, fed into the operation
+ *              counts of each bi_modexp window width (see window_cost).
+ *   batch      the ordered pool encrypting in-memory blocks with the
+ *              stock key at several window widths per compute thread.
+ *
+ * Usage: rsa_tune [output_file]   (stdout by default, progress on stderr)
+ */
+
+#define MIN_SAMPLE_NS  1000000.0
+#define SAMPLES        5
+#define WIN_MOD_BITS   512
+#define WIN_MAX_EXP_BITS 16384
+#define POOL_BLOCKS    4096
+
+// Fastest of SAMPLES timings in nanoseconds per call, each sample batched to at least MIN_SAMPLE_NS.
+static double time_op(TimedFn fn, void *ctx)
+{
+    size_t iters = bench_iters(bench_sample(fn, ctx, 1), MIN_SAMPLE_NS);
+    double s[SAMPLES];
+    for (size_t k = 0; k < SAMPLES; ++k) s[k] = bench_sample(fn, ctx, iters);
+    qsort(s, SAMPLES, sizeof *s, bench_cmp_double);
+    return s[0];                  // noise only ever adds time
+}
+
+
+typedef struct { BigInt *a, *b; } Operands;
+
+static void run_mul(void *ctx)
+{
+    Operands *o = ctx;
+    BigInt *r = NULL;
+    bi_mul(o->a, o->b, &r);
+    bi_free(r);
+}
+
+static void run_divmod(void *ctx)
+{
+    Operands *o = ctx;
+    BigInt *q = NULL, *r = NULL;
+    bi_divmod(o->a, o->b, &q, &r);
+    bi_free(q);
+    bi_free(r);
+}
+
+/* Times fn on (ratio * n)- and n-limb operands with *knob past every size
+ * (method off) and at n (one level of it, smaller pieces fall back), and
+ * returns the first size where the method wins twice running; one-off wins
+ * are noise.
+ */
+static size_t crossover(const char *what, const size_t *sizes, size_t nsizes, size_t ratio,
+                        TimedFn fn, size_t *knob)
+{
+    bool wins[32];
+    for (size_t i = 0; i < nsizes; ++i) {
+        Operands o = { bench_random_bits(ratio * sizes[i] * 32, false), bench_random_bits(sizes[i] * 32, false) };
+        *knob = SIZE_MAX;
+        double off = time_op(fn, &o);
+        *knob = sizes[i];
+        double on = time_op(fn, &o);
+        wins[i] = on < off;
+        fprintf(stderr, "%-9s %5zu limbs: without %10.0f ns, with %10.0f ns\n", what, sizes[i], off, on);
+        bi_free(o.a); bi_free(o.b);
+    }
+    for (size_t i = 0; i + 1 < nsizes; ++i)
+        if (wins[i] && wins[i + 1]) return sizes[i];
+    return 2 * sizes[nsizes - 1];
+}
+
+static size_t tune_karatsuba(void)
+{
+    static const size_t sizes[] = { 8, 12, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 128, 160, 192, 256 };
+    return crossover("karatsuba", sizes, sizeof sizes / sizeof *sizes, 1, run_mul,
+                     &bi_tuning.karatsuba_limbs);
+}
+
+static size_t tune_ntt(void)
+{
+    static const size_t sizes[] = { 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 16384 };
+    return crossover("ntt", sizes, sizeof sizes / sizeof *sizes, 1, run_mul, &bi_tuning.ntt_limbs);
+}
+
+static size_t tune_par(void)
+{
+    static const size_t sizes[] = { 256, 512, 1024, 2048, 4096, 8192, 16384 };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 2) {
+        fprintf(stderr, "par: single CPU, keeping %d\n", BI_PAR_MUL_THRESHOLD);
+        return BI_PAR_MUL_THRESHOLD;
+    }
+    pool_shared_set_threads((size_t)cpus);
+    size_t par = crossover("par", sizes, sizeof sizes / sizeof *sizes, 1, run_mul,
+                           &bi_tuning.par_mul_limbs);
+    pool_shared_set_threads(1);   // the division ladders time serial bi_mul
+    return par;
+}
+
+// 2n / n divisions, the step Burnikel-Ziegler recurses on.
+static size_t tune_bz(void)
+{
+    static const size_t sizes[] = { 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024 };
+    return crossover("bz", sizes, sizeof sizes / sizeof *sizes, 2, run_divmod, &bi_tuning.bz_limbs);
+}
+
+// 4n / n divisions: the Newton reciprocal is paid once and reused per digit.
+static size_t tune_newton(void)
+{
+    static const size_t sizes[] = { 128, 256, 512, 1024, 2048, 4096 };
+    return crossover("newton", sizes, sizeof sizes / sizeof *sizes, 4, run_divmod,
+                     &bi_tuning.newton_limbs);
+}
+
+typedef struct { BigInt *x, *y, *m; } MulMod;
+
+static void run_mulmod(void *ctx)
+{
+    MulMod *o = ctx;
+    BigInt *t = NULL, *r = NULL;
+    bi_mul(o->x, o->y, &t);
+    if (t) bi_mod(t, o->m, &r);
+    bi_free(t);
+    bi_free(r);
+}
+
+/* Sliding-window cost for a b-bit exponent: one squaring and 2^(w-1) - 1
+ * multiplies for the table, then about b squarings and b / (w + 1)
+ * multiplies. Timing whole exponentiations instead drowns the small
+ * differences between neighbouring widths in noise, so the two kernel
+ * costs are measured and the counts do the rest.
+ */
+static double window_cost(unsigned w, double b, double sqr, double mul)
+{
+    return sqr + ((1u << (w - 1)) - 1) * mul + b * sqr + b / (w + 1) * mul;
+}
+
+static void tune_window(uint32_t above[BI_MODEXP_MAX_WINDOW - 1])
+{
+    BigInt *m = bench_random_bits(WIN_MOD_BITS, true);
+    MulMod sq = { bench_random_bits(WIN_MOD_BITS - 1, false), NULL, m };
+    MulMod mu = { sq.x, bench_random_bits(WIN_MOD_BITS - 1, false), m };
+    sq.y = sq.x;
+    double sqr = time_op(run_mulmod, &sq);
+    double mul = time_op(run_mulmod, &mu);
+    fprintf(stderr, "window: %u-bit squaring %.0f ns, multiply %.0f ns\n", WIN_MOD_BITS, sqr, mul);
+
+    for (unsigned k = 0; k < BI_MODEXP_MAX_WINDOW - 1; ++k) above[k] = 0;
+    for (uint32_t b = 1; b <= WIN_MAX_EXP_BITS; ++b) {
+        unsigned best_w = 1;
+        for (unsigned w = 2; w <= BI_MODEXP_MAX_WINDOW; ++w)
+            if (window_cost(w, b, sqr, mul) < window_cost(best_w, b, sqr, mul)) best_w = w;
+        // Every wider window waits until past the last length it lost at
+        for (unsigned k = best_w - 1; k < BI_MODEXP_MAX_WINDOW - 1; ++k) above[k] = b;
+    }
+    fprintf(stderr, "window: widths 2..%u from", BI_MODEXP_MAX_WINDOW);
+    for (unsigned k = 0; k < BI_MODEXP_MAX_WINDOW - 1; ++k) fprintf(stderr, " %u", above[k] + 1);
+    fprintf(stderr, " exponent bits\n");
+    bi_free(sq.x); bi_free(mu.y); bi_free(m);
+}
+
+
+typedef struct {
+    RSAKey pub;
+    size_t width, nthreads;
+} PoolBench;
+
+static int pb_load(void *ctx, size_t idx, void *slot)
+{
+    (void)ctx;
+    if (idx >= POOL_BLOCKS) return 0;
+    BigInt *m = bi_from_u64(0x01000193u * (idx + 1));
+    *(BigInt **)slot = m;
+    return m ? 1 : -1;
+}
+
+static int pb_compute(void *ctx, size_t idx, void *slot)
+{
+    PoolBench *pb = ctx;
+    BigInt *c = NULL;
+    (void)idx;
+    rsa_encrypt(*(BigInt **)slot, &pb->pub, &c);
+    bi_free(*(BigInt **)slot);
+    *(BigInt **)slot = c;
+    return c ? 0 : -1;
+}
+
+static int pb_emit(void *ctx, size_t idx, void *slot)
+{
+    (void)ctx; (void)idx;
+    bi_free(*(BigInt **)slot);
+    return 0;
+}
+
+static void pb_discard(void *ctx, void *slot)
+{
+    (void)ctx;
+    bi_free(*(BigInt **)slot);
+}
+
+static void run_pool(void *ctx)
+{
+    PoolBench *pb = ctx;
+    PoolJob job = {
+        .nthreads  = pb->nthreads,
+        .window    = pb->nthreads * pb->width,
+        .slot_size = sizeof(BigInt *),
+        .ctx       = pb,
+        .load      = pb_load,
+        .compute   = pb_compute,
+        .emit      = pb_emit,
+        .discard   = pb_discard,
+    };
+    if (pool_run_ordered(&job) != 0) {
+        fprintf(stderr, "Error: pool run failed while tuning.\n");
+        exit(1);
+    }
+}
+
+static size_t tune_batch(void)
+{
+    static const size_t widths[] = { 4, 8, 16, 32, 64, 128, 256 };
+    const size_t nwidths = sizeof widths / sizeof *widths;
+    RSAKey priv;
+    PoolBench pb;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    rsa_generate_keypair(&pb.pub, &priv, 64);
+    // At least two compute threads, or the pool runs serially and ignores the width
+    pb.nthreads = (cpus > 2) ? (size_t)cpus : 2;
+
+    double t[sizeof widths / sizeof *widths], best = 0;
+    for (size_t i = 0; i < nwidths; ++i) {
+        pb.width = widths[i];
+        t[i] = time_op(run_pool, &pb);
+        fprintf(stderr, "batch width %4zu x %zu threads: %8.0f ns/block\n",
+                widths[i], pb.nthreads, t[i] / POOL_BLOCKS);
+        if (i == 0 || t[i] < best) best = t[i];
+    }
+    rsa_free_key(&pb.pub);
+    rsa_free_key(&priv);
+    // The smallest width within 3% of the best: same speed, less memory
+    for (size_t i = 0; i < nwidths; ++i)
+        if (t[i] <= best * 1.03) return widths[i];
+    return BI_BATCH_WIDTH;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        fprintf(stderr, "Usage: %s [output_file]\n", argv[0]);
+        return 1;
+    }
+    uint32_t above[BI_MODEXP_MAX_WINDOW - 1];
+
+    size_t kara = tune_karatsuba();
+    bi_tuning.karatsuba_limbs = kara;
+    size_t ntt = tune_ntt();
+    bi_tuning.ntt_limbs = ntt;
+    size_t par = tune_par();
+    bi_tuning.par_mul_limbs = par;
+    size_t bz = tune_bz();
+    bi_tuning.bz_limbs = bz;
+    size_t newton = tune_newton();
+    bi_tuning.newton_limbs = newton;
+    tune_window(above);
+    size_t width = tune_batch();
+
+    FILE *out = (argc == 2) ? fopen(argv[1], "w") : stdout;
+    if (!out) { perror(argv[1]); return 1; }
+    char host[256] = "this host";
+    gethostname(host, sizeof host - 1);
+    fprintf(out, "// Generated by rsa_tune (`make tune`) on %s. Remove this file to\n"
+                 "// go back to the portable defaults in tune.h.\n", host);
+    fprintf(out, "#ifndef BI_TUNE_H\n#define BI_TUNE_H\n\n");
+    fprintf(out, "#define BI_KARATSUBA_THRESHOLD %zu\n", kara);
+    fprintf(out, "#define BI_NTT_THRESHOLD %zu\n", ntt);
+    fprintf(out, "#define BI_PAR_MUL_THRESHOLD %zu\n", par);
+    fprintf(out, "#define BI_BZ_THRESHOLD %zu\n", bz);
+    fprintf(out, "#define BI_NEWTON_THRESHOLD %zu\n", newton);
+    fprintf(out, "#define BI_MODEXP_WINDOW_ABOVE {");
+    for (unsigned k = 0; k < BI_MODEXP_MAX_WINDOW - 1; ++k)
+        fprintf(out, "%s %u", k ? "," : "", above[k]);
+    fprintf(out, " }\n");
+    fprintf(out, "#define BI_BATCH_WIDTH %zu\n\n#endif\n", width);
+
+    if (out != stdout && fclose(out) != 0) { perror(argv[1]); return 1; }
+    return 0;
+}
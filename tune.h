@@ -0,0 +1,50 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+/* Algorithm thresholds. `make tune` measures them on the build host and
+ * writes bi_tune.h; the Makefile then builds with -DBI_HAVE_TUNE so the
+ * values below are replaced. Anything bi_tune.h leaves out keeps the
+ * portable default.
+ */
+#ifdef BI_HAVE_TUNE
+#include "bi_tune.h"
+#endif
+
+// bi_mul uses Karatsuba when both operands have at least this many limbs.
+#ifndef BI_KARATSUBA_THRESHOLD
+#define BI_KARATSUBA_THRESHOLD 40
+#endif
+
+// bi_mul switches to the number-theoretic transform (bi_ntt.c) when the
+// smaller operand has at least this many limbs.
+#ifndef BI_NTT_THRESHOLD
+#define BI_NTT_THRESHOLD 2048
+#endif
+
+// bi_mul splits Karatsuba and NTT products of at least this many limbs
+// across the shared thread pool (pool_fork_join), if it has threads.
+#ifndef BI_PAR_MUL_THRESHOLD
+#define BI_PAR_MUL_THRESHOLD 2048
+#endif
+
+// bi_divmod uses Burnikel-Ziegler for divisors of at least this many limbs,
+// and Barrett steps with a Newton reciprocal from the second one.
+#ifndef BI_BZ_THRESHOLD
+#define BI_BZ_THRESHOLD 256
+#endif
+#ifndef BI_NEWTON_THRESHOLD
+#define BI_NEWTON_THRESHOLD 8192
+#endif
+
+// bi_modexp window: w + 2 bits once the exponent is longer than entry w.
+#define BI_MODEXP_MAX_WINDOW 6
+#ifndef BI_MODEXP_WINDOW_ABOVE
+#define BI_MODEXP_WINDOW_ABOVE { 7, 23, 79, 239, 671 }
+#endif
+
+// Blocks kept in flight per compute thread by the ordered pool.
+#ifndef BI_BATCH_WIDTH
+#define BI_BATCH_WIDTH 64
+#endif
+
+#endif